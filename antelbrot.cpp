@@ -4,14 +4,43 @@
 // http://www.superfractalthing.co.nf/sft_maths.pdf
 
 #include <SFML/Graphics.hpp>
+#include <SFML/OpenGL.hpp>
+#include <GL/glext.h>
 #include <complex>
 #include <vector>
 #include <cmath>
+#include <cfloat>
 #include <iostream>
+#include <fstream>
+#include <sstream>
 #include <cmath>
 #include <string>
 #include <map>
 #include <regex>
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <thread>
+#include <cstdint>
+#include <cstring>
+#include <climits>
+#include <limits>
+#include <chrono>
+#include <cstdio>
+#include <type_traits>
+#include <cerrno>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
 #include <gmpxx.h>
 
 using std::cout;
@@ -19,161 +48,5998 @@ using std::endl;
 using std::vector;
 using std::cin;
 
+// Thread pool
+
+// counts the jobs of one batch of work so that its submitter can wait for it
+struct task_group
+{
+    std::atomic<int> pending {0};
+};
+
+// A fixed set of worker threads that lives for the whole program. Every worker
+// has its own deque of jobs: it takes work from the back of its own deque and,
+// once that runs dry, steals from the front of the others. This keeps all the
+// cores busy even when some jobs take much longer than the rest.
+class thread_pool
+{
+public:
+    explicit thread_pool(unsigned threads)
+    {
+        if (threads == 0)
+            threads = 1;
+        for (unsigned i = 0; i != threads; ++i)
+            queues.emplace_back(new job_queue);
+        for (unsigned i = 0; i != threads; ++i)
+            workers.emplace_back(&thread_pool::run, this, i);
+    }
+
+    ~thread_pool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleep_lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto &t : workers)
+            t.join();
+    }
+
+    unsigned size() const { return workers.size(); }
+
+    void submit(task_group &group, std::function<void()> job)
+    {
+        ++group.pending;
+        // deal the jobs out round robin, stealing evens out the rest
+        job_queue &q = *queues[next_queue++ % queues.size()];
+        {
+            std::lock_guard<std::mutex> lock(q.lock);
+            q.jobs.push_back(job_entry {std::move(job), &group});
+        }
+        {
+            std::lock_guard<std::mutex> lock(sleep_lock);
+            ++queued;
+        }
+        wake.notify_one();
+    }
+
+    // block until every job of the group has run, helping out meanwhile
+    void wait(task_group &group)
+    {
+        job_entry job;
+        while (group.pending != 0)
+        {
+            if (take(queues.size(), job))
+            {
+                execute(job);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleep_lock);
+            finished.wait(lock, [&]
+            {
+                return group.pending == 0 || queued != 0;
+            });
+        }
+    }
+
+private:
+    struct job_entry
+    {
+        std::function<void()> work;
+        task_group *group;
+    };
+
+    struct job_queue
+    {
+        std::mutex lock;
+        std::deque<job_entry> jobs;
+    };
+
+    // pop from the back of our own deque, otherwise steal from the front of
+    // another one. index == queues.size() means a thread outside the pool.
+    bool take(unsigned index, job_entry &job)
+    {
+        unsigned n = queues.size();
+        for (unsigned k = 0; k != n; ++k)
+        {
+            unsigned victim = (index + k) % n;
+            job_queue &q = *queues[victim];
+            std::lock_guard<std::mutex> lock(q.lock);
+            if (q.jobs.empty())
+                continue;
+            if (victim == index)
+            {
+                job = std::move(q.jobs.back());
+                q.jobs.pop_back();
+            }
+            else
+            {
+                job = std::move(q.jobs.front());
+                q.jobs.pop_front();
+            }
+            std::lock_guard<std::mutex> sleep(sleep_lock);
+            --queued;
+            return true;
+        }
+        return false;
+    }
+
+    void execute(job_entry &job)
+    {
+        job.work();
+        job.work = nullptr;
+        if (--job.group->pending == 0)
+        {
+            // take the lock so a waiter can't miss the wakeup
+            std::lock_guard<std::mutex> lock(sleep_lock);
+            finished.notify_all();
+        }
+    }
+
+    void run(unsigned index)
+    {
+        job_entry job;
+        while (true)
+        {
+            if (take(index, job))
+            {
+                execute(job);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleep_lock);
+            wake.wait(lock, [&] { return stopping || queued != 0; });
+            if (stopping)
+                return;
+        }
+    }
+
+    vector<std::unique_ptr<job_queue>> queues;
+    vector<std::thread> workers;
+    std::atomic<unsigned> next_queue {0};
+
+    // protects queued and stopping, and is what idle threads sleep on
+    std::mutex sleep_lock;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    int queued = 0;
+    bool stopping = false;
+};
+
 // Color algorithms
 
-sf::Color interpolate(const sf::Color &color1, const sf::Color &color2,
-                      const double &mid)
+sf::Color interpolate(const sf::Color &color1, const sf::Color &color2,
+                      const double &mid)
+{
+    int r = color1.r + (color2.r - color1.r) * mid;
+    int g = color1.g + (color2.g - color1.g) * mid;
+    int b = color1.b + (color2.b - color1.b) * mid;
+    return sf::Color(r, g, b);
+}
+
+// This function takes a vector of colors, and returns a gradient based on
+// the original vector. The table gets at least 100 entries per color, and a
+// power of two of them in all, so that palette() wraps around it with a mask.
+vector<sf::Color> color_table(const vector<sf::Color> &gradient)
+{
+    size_t size = 1;
+    while (size < 100 * gradient.size())
+        size *= 2;
+    vector<sf::Color> v(size);
+    for (size_t k = 0; k != size; ++k)
+    {
+        // interpolate between this and the next color of the input gradient
+        double d = (double) k * gradient.size() / size;
+        size_t i = (size_t) d;
+        size_t next = (i + 1 == gradient.size()) ? 0 : i + 1;
+        v[k] = interpolate(gradient[i], gradient[next], d - i);
+    }
+    return v;
+}
+
+// log2 x for a normal x > 0, from its exponent bits and a series for the
+// rest. The error is about 1e-9, and there's no call or branch in it, so
+// loops over arrays of it vectorize.
+inline double fast_log2(double x)
+{
+    // x = m 2^e with m in [sqrt(1/2), sqrt(2)), so that the series on
+    // s = (m - 1) / (m + 1) only sees |s| < 0.172
+    uint64_t bits;
+    std::memcpy(&bits, &x, sizeof bits);
+    uint64_t shifted = bits - 0x3fe6a09e667f3bcd + (1023ull << 52);
+    uint64_t e = shifted >> 52;
+    bits -= (e - 1023) << 52;
+    double m;
+    std::memcpy(&m, &bits, sizeof m);
+
+    // log2 m = 2 / ln 2 * (s + s^3 / 3 + s^5 / 5 + ...)
+    double s = (m - 1) / (m + 1), s2 = s * s;
+    double series = 2.8853900817779268 + s2 * (0.9617966939259756 +
+                    s2 * (0.5770780163555854 + s2 * (0.4121985831111324 +
+                    s2 * 0.3205988979753252)));
+    return (double) ((int) e - 1023) + s * series;
+}
+
+// the smooth iteration count of an escaped point, using logarithmic smoothing
+double smooth_iter(double zn_size, int iter)
+{
+    return iter - fast_log2(fast_log2(zn_size));
+}
+
+// smooth iteration counts for n kernel results at once. Only those of
+// escaped pixels mean anything, but computing all of them keeps the loop
+// free of branches.
+void smooth_iters(const int *iter, const double *zn_size, int n, float *nu)
+{
+    for (int k = 0; k != n; ++k)
+        nu[k] = smooth_iter(std::max(zn_size[k], 2.0), iter[k]);
+}
+
+sf::Color palette(const vector<sf::Color> &gradient, double nu)
+{
+    // use smooth coloring
+    int i = (int) (nu * 10) & (gradient.size() - 1);
+
+    return gradient[i];
+}
+
+// Extended range numbers
+
+// A double mantissa with a separate exponent, value = m * 2^e. The mantissa is
+// kept in [1, 2) (or is 0), so numbers can get far smaller than the 1e-308 a
+// plain double stops at. Only the deltas of very deep zooms use this; the
+// normal path stays on double.
+struct floatexp
+{
+    double m;
+    int64_t e;
+
+    // exponent used for 0, small enough that it never wins an alignment
+    static const int64_t zero_exp = INT64_MIN / 4;
+
+    floatexp() : m(0), e(zero_exp) {}
+    floatexp(double d) { *this = normalise(d, 0); }
+
+    static floatexp normalise(double m, int64_t e)
+    {
+        uint64_t bits;
+        std::memcpy(&bits, &m, sizeof bits);
+        int64_t biased = (bits >> 52) & 0x7ff;
+        if (biased == 0)
+        {
+            // zero or a denormal
+            if (m == 0)
+                return floatexp();
+            int k;
+            m = std::frexp(m, &k);
+            return normalise(m, e + k);
+        }
+        // replace the double's own exponent so the mantissa ends up in [1, 2)
+        bits = (bits & 0x800fffffffffffffULL) | (1023ULL << 52);
+        floatexp f;
+        std::memcpy(&f.m, &bits, sizeof bits);
+        f.e = e + biased - 1023;
+        return f;
+    }
+
+    static floatexp from_mpf(mpf_srcptr x)
+    {
+        long exp;
+        double d = mpf_get_d_2exp(&exp, x);
+        return normalise(d, exp);
+    }
+
+    static floatexp from_mpf(const mpf_class &x)
+    {
+        return from_mpf(x.get_mpf_t());
+    }
+
+    // 2^k as a double, for k in the normal range
+    static double exp2i(int64_t k)
+    {
+        uint64_t bits = (uint64_t) (k + 1023) << 52;
+        double d;
+        std::memcpy(&d, &bits, sizeof d);
+        return d;
+    }
+
+    explicit operator double() const
+    {
+        if (e > 1023)
+            return m * INFINITY;
+        if (e < -1022)
+            return e < -1100 ? 0 : std::ldexp(m, e);
+        return m * exp2i(e);
+    }
+
+    double get_d() const { return (double) *this; }
+
+    // m * 2^k, for turning this into an mpf_class
+    mpf_class get_mpf(mp_bitcnt_t bits) const
+    {
+        mpf_class r(m, bits);
+        if (m != 0)
+        {
+            if (e >= 0)
+                mpf_mul_2exp(r.get_mpf_t(), r.get_mpf_t(), e);
+            else
+                mpf_div_2exp(r.get_mpf_t(), r.get_mpf_t(), -e);
+        }
+        return r;
+    }
+};
+
+inline floatexp operator*(const floatexp &a, const floatexp &b)
+{
+    return floatexp::normalise(a.m * b.m, a.e + b.e);
+}
+
+inline floatexp operator/(const floatexp &a, const floatexp &b)
+{
+    return floatexp::normalise(a.m / b.m, a.e - b.e);
+}
+
+inline floatexp operator+(const floatexp &a, const floatexp &b)
+{
+    // shift the smaller number onto the exponent of the larger one
+    const floatexp &big = (a.e >= b.e) ? a : b;
+    const floatexp &small = (a.e >= b.e) ? b : a;
+    int64_t shift = big.e - small.e;
+    if (shift > 64)
+        return big;
+    double m = big.m + small.m * floatexp::exp2i(-shift);
+    return floatexp::normalise(m, big.e);
+}
+
+inline floatexp operator-(const floatexp &a)
+{
+    floatexp r = a;
+    r.m = -r.m;
+    return r;
+}
+
+inline floatexp operator-(const floatexp &a, const floatexp &b)
+{
+    return a + -b;
+}
+
+inline floatexp &operator*=(floatexp &a, const floatexp &b) { return a = a * b; }
+inline floatexp &operator/=(floatexp &a, const floatexp &b) { return a = a / b; }
+inline floatexp &operator+=(floatexp &a, const floatexp &b) { return a = a + b; }
+
+inline bool operator<(const floatexp &a, const floatexp &b)
+{
+    return (a - b).m < 0;
+}
+
+inline bool operator>(const floatexp &a, const floatexp &b) { return b < a; }
+
+inline floatexp sqrt(const floatexp &a)
+{
+    if (a.m == 0)
+        return a;
+    // halve an even exponent, moving the odd bit into the mantissa
+    int64_t odd = a.e & 1;
+    return floatexp::normalise(std::sqrt(a.m * (1 + odd)), (a.e - odd) / 2);
+}
+
+std::ostream &operator<<(std::ostream &out, const floatexp &f)
+{
+    if (f.e > -1000 && f.e < 1000)
+        return out << f.get_d();
+
+    // print the decimal mantissa and exponent by hand
+    double digits = (f.e + std::log2(std::fabs(f.m))) * std::log10(2.0);
+    double exp10 = std::floor(digits);
+    double mantissa = std::pow(10.0, digits - exp10);
+    if (mantissa >= 10 - 5 * std::pow(10.0, -(double) out.precision()))
+    {
+        // it would print as 10
+        mantissa /= 10;
+        exp10 += 1;
+    }
+    return out << (f.m < 0 ? "-" : "") << mantissa << "e" << (long) exp10;
+}
+
+std::istream &operator>>(std::istream &in, floatexp &f)
+{
+    // go through GMP, which reads exponents of any size
+    std::string str;
+    if (in >> str)
+    {
+        mpf_class x;
+        if (x.set_str(str, 10) == 0)
+            f = floatexp::from_mpf(x);
+        else
+            in.setstate(std::ios::failbit);
+    }
+    return in;
+}
+
+// A complex number over any of the real types above. std::complex is only
+// specified for the builtin floating point types.
+template <typename R>
+struct complex_t
+{
+    R re, im;
+
+    complex_t() : re(0), im(0) {}
+    complex_t(const R &r, const R &i = R(0)) : re(r), im(i) {}
+    complex_t(const std::complex<double> &z) : re(z.real()), im(z.imag()) {}
+
+    template <typename S>
+    explicit complex_t(const complex_t<S> &z) : re(static_cast<R>(z.re)),
+                                                im(static_cast<R>(z.im)) {}
+};
+
+template <typename R>
+inline complex_t<R> operator+(const complex_t<R> &a, const complex_t<R> &b)
+{
+    return complex_t<R>(a.re + b.re, a.im + b.im);
+}
+
+template <typename R>
+inline complex_t<R> operator-(const complex_t<R> &a, const complex_t<R> &b)
+{
+    return complex_t<R>(a.re - b.re, a.im - b.im);
+}
+
+template <typename R>
+inline complex_t<R> operator*(const complex_t<R> &a, const complex_t<R> &b)
+{
+    return complex_t<R>(a.re * b.re - a.im * b.im, a.re * b.im + a.im * b.re);
+}
+
+template <typename R>
+inline R norm(const complex_t<R> &z)
+{
+    return z.re * z.re + z.im * z.im;
+}
+
+typedef complex_t<floatexp> complexfe;
+
+// A floatexp in 12 bytes rather than 16, for the values an orbit keeps for
+// every iteration. 32 bits of exponent are far more than the precision of
+// any orbit can use.
+struct packed_floatexp
+{
+    double m;
+    int32_t e;
+
+    packed_floatexp(const floatexp &f)
+        : m(f.m), e(f.m == 0 ? 0 : (int32_t) f.e) {}
+
+    operator floatexp() const
+    {
+        if (m == 0)
+            return floatexp();
+        floatexp f;
+        f.m = m;
+        f.e = e;
+        return f;
+    }
+} __attribute__((packed));
+
+struct packed_complexfe
+{
+    packed_floatexp re, im;
+
+    packed_complexfe(const complexfe &z) : re(z.re), im(z.im) {}
+    operator complexfe() const { return complexfe(re, im); }
+};
+
+// Math algorithms
+
+// a file mapped into memory for as long as this lives
+struct mapped_file
+{
+    void *base = MAP_FAILED;
+    size_t length = 0;
+
+    // an existing file, read only
+    explicit mapped_file(const std::string &path)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return;
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size > 0)
+        {
+            length = info.st_size;
+            base = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+        }
+        close(fd);
+    }
+
+    // A new file of size bytes in $TMPDIR (or /var/tmp, which is on disk
+    // where /tmp often isn't), writable and removed right away, so it goes
+    // with the mapping. Its pages are only backed once written.
+    explicit mapped_file(size_t size)
+    {
+        const char *dir = getenv("TMPDIR");
+        std::string path = std::string(dir && *dir ? dir : "/var/tmp") +
+                           "/antelbrot-XXXXXX";
+        int fd = mkstemp(&path[0]);
+        if (fd < 0)
+            return;
+        unlink(path.c_str());
+        if (ftruncate(fd, size) == 0)
+        {
+            length = size;
+            base = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED,
+                        fd, 0);
+        }
+        close(fd);
+    }
+
+    ~mapped_file()
+    {
+        if (base != MAP_FAILED)
+            munmap(base, length);
+    }
+
+    bool ok() const { return base != MAP_FAILED; }
+    const char *bytes() const { return (const char *) base; }
+};
+
+// The points of a reference orbit. They live in the orbit_buffer they were
+// computed into or in a file of the orbit cache mapped into memory, and are
+// never written once the orbit is done, so copies share them.
+class orbit_points
+{
+public:
+    orbit_points() {}
+
+    // points kept alive by storage
+    orbit_points(std::shared_ptr<const void> storage,
+                 const std::complex<double> *first, size_t count)
+        : storage(std::move(storage)), first(first), count(count) {}
+
+    const std::complex<double> *data() const { return first; }
+    size_t size() const { return count; }
+    const std::complex<double> &operator[](size_t n) const { return first[n]; }
+
+    // the first n points, on the same storage
+    orbit_points prefix(size_t n) const
+    {
+        return orbit_points(storage, first, std::min(n, count));
+    }
+
+private:
+    std::shared_ptr<const void> storage;
+    const std::complex<double> *first = nullptr;
+    size_t count = 0;
+};
+
+// Orbits of more points than this (64 MB of them) are computed into a
+// temporary file mapped into memory rather than onto the heap, so that their
+// pages are backed by the file instead of needing swap. The whole orbit is
+// mapped, at 16 bytes a point as on the heap: the kernels read the same
+// points, and the memory they touch is the same.
+const size_t mapped_orbit_size = size_t(1) << 22;
+
+// Room for the points of an orbit while it is computed, allocated once for
+// the whole depth so that it never moves or gets copied as it grows. Only
+// the points the orbit gets to are touched, so an orbit that escapes early
+// costs no more than its length.
+class orbit_buffer
+{
+public:
+    // room for capacity points, starting with those of from
+    explicit orbit_buffer(size_t capacity,
+                          const orbit_points &from = orbit_points())
+    {
+        capacity = std::max(capacity, from.size());
+        size_t bytes = std::max<size_t>(capacity, 1) *
+                       sizeof(std::complex<double>);
+        if (capacity > mapped_orbit_size)
+        {
+            std::shared_ptr<mapped_file> file(new mapped_file(bytes));
+            if (file->ok())
+            {
+                first = (std::complex<double> *) file->base;
+                storage = file;
+            }
+        }
+        if (!first)
+        {
+            first = (std::complex<double> *) malloc(bytes);
+            if (!first)
+                throw std::bad_alloc();
+            storage = std::shared_ptr<void>(first, free);
+        }
+        std::copy(from.data(), from.data() + from.size(), first);
+        count = from.size();
+    }
+
+    size_t size() const { return count; }
+    void push_back(const std::complex<double> &x) { first[count++] = x; }
+
+    // the points so far, on the same storage
+    orbit_points points() const { return orbit_points(storage, first, count); }
+
+private:
+    std::shared_ptr<void> storage;
+    std::complex<double> *first = nullptr;
+    size_t count = 0;
+};
+
+// The high precision point an orbit has got to, from which it can go on.
+struct orbit_state
+{
+    mpf_class xn_r, xn_i;
+};
+
+// The reference orbit, stored as 2 * X_n so the kernels save a multiply, and
+// the series approximation of the pixel deltas around it:
+// d_n ~ a[n] d0 + b[n] d0^2 + c[n] d0^3
+// The coefficients grow roughly like the inverse powers of the radius, so they
+// are kept in extended range. They often go on for the whole orbit, and are
+// packed to take 72 bytes per iteration rather than 96.
+struct reference_orbit
+{
+    orbit_points x;
+    vector<packed_complexfe> a, b, c;
+    mp_bitcnt_t bits;   // precision the orbit was computed at
+
+    // whether the orbit ends because it escaped, and otherwise the high
+    // precision point after its last one, to go on from when more iterations
+    // are wanted (null if it isn't known)
+    bool escaped = false;
+    std::shared_ptr<orbit_state> end;
+};
+
+// where the kernels start: every pixel begins at iteration skip, with its
+// delta given by the series coefficients of that iteration
+struct series_step
+{
+    int skip;
+    complexfe a, b, c;
+
+    // the same coefficients times radius, radius^2 and radius^3, so that
+    // the double kernels can evaluate the series on u = d0 / radius without
+    // the coefficients overflowing
+    std::complex<double> ua, ub, uc;
+    double inv_radius;
+};
+
+// the delta of a pixel at the iteration the series skips to
+inline complexfe series_delta(const series_step &start, const complexfe &d0)
+{
+    return ((start.c * d0 + start.b) * d0 + start.a) * d0;
+}
+
+// Bits of precision needed for the center and the reference orbit at this
+// radius: enough to resolve a pixel, plus a margin for the rounding errors
+// that build up along the orbit. radius.e is about log2(radius).
+mp_bitcnt_t precision_bits(const floatexp &radius)
+{
+    return std::max<int64_t>(64 - radius.e, 64);
+}
+
+// make sure the center has enough bits to be moved around at this radius
+void fit_precision(mpf_class &center_r, mpf_class &center_i,
+                   const floatexp &radius)
+{
+    mp_bitcnt_t bits = precision_bits(radius);
+    if (center_r.get_prec() < bits)
+        center_r.set_prec(bits);
+    if (center_i.get_prec() < bits)
+        center_i.set_prec(bits);
+}
+
+// Take xn to xn^2 + c in place, with three multiplications:
+// xn_r = xn_r^2 - xn_i^2 + c_r
+// xn_i = (xn_r + xn_i)^2 - xn_r^2 - xn_i^2 + c_i
+// sq_r, sq_i and sum are scratch.
+inline void mandelbrot_step(mpf_ptr xn_r, mpf_ptr xn_i, mpf_srcptr c_r,
+                            mpf_srcptr c_i, mpf_ptr sq_r, mpf_ptr sq_i,
+                            mpf_ptr sum)
+{
+    mpf_mul(sq_r, xn_r, xn_r);
+    mpf_mul(sq_i, xn_i, xn_i);
+    mpf_add(sum, xn_r, xn_i);
+    mpf_mul(sum, sum, sum);
+    mpf_sub(sum, sum, sq_r);
+    mpf_sub(sum, sum, sq_i);
+    mpf_add(xn_i, sum, c_i);
+    mpf_sub(xn_r, sq_r, sq_i);
+    mpf_add(xn_r, xn_r, c_r);
+}
+
+// Append the points of the orbit of the center to v, which has room for
+// depth points, going on from state until v holds depth points, and leave
+// state at the point after the last one. Returns true if the orbit escaped,
+// in which case state is the point that did.
+bool extend_orbit(const mpf_class &center_r, const mpf_class &center_i,
+                  int depth, mp_bitcnt_t bits, orbit_buffer &v,
+                  orbit_state &state, const std::atomic<bool> *cancel)
+{
+    // All the work happens in place on these, so no iteration allocates
+    // limbs. sq_r and sq_i hold the squares, sum is scratch.
+    state.xn_r.set_prec(bits);
+    state.xn_i.set_prec(bits);
+    mpf_ptr xn_r = state.xn_r.get_mpf_t(), xn_i = state.xn_i.get_mpf_t();
+    mpf_t c_r, c_i, sq_r, sq_i, sum;
+    mpf_t *registers[] = {&c_r, &c_i, &sq_r, &sq_i, &sum};
+    for (mpf_t *r : registers)
+        mpf_init2(*r, bits);
+    mpf_set(c_r, center_r.get_mpf_t());
+    mpf_set(c_i, center_i.get_mpf_t());
+
+    bool escaped = false;
+    for (int i = v.size(); i < depth; ++i)
+    {
+        // give up on an orbit nobody wants any more
+        if (cancel && i % 4096 == 0 && *cancel)
+            break;
+
+        // pre multiply by two, which is exact in double
+        double re = 2 * mpf_get_d(xn_r);
+        double im = 2 * mpf_get_d(xn_i);
+
+        v.push_back(std::complex<double>(re, im));
+
+        // make sure our numbers don't get too big
+        if (re > 1024 || im > 1024 || re < -1024 || im < -1024)
+        {
+            escaped = true;
+            break;
+        }
+
+        mandelbrot_step(xn_r, xn_i, c_r, c_i, sq_r, sq_i, sum);
+    }
+    for (mpf_t *r : registers)
+        mpf_clear(*r);
+    return escaped;
+}
+
+// The series coefficients follow from d_n+1 = 2 X_n d_n + d_n^2 + d0,
+// starting from d_0 = d0. The series needs |d0| < |a| / |b|; stop once
+// that is below anything the center's precision can resolve.
+void series_coefficients(reference_orbit &orbit)
+{
+    const orbit_points &v = orbit.x;
+    floatexp limit = floatexp::normalise(1, 2 * orbit.bits);
+    // reserving only takes address space, the pages that are never
+    // written cost nothing
+    orbit.a.reserve(v.size());
+    orbit.b.reserve(v.size());
+    orbit.c.reserve(v.size());
+    complexfe a(floatexp(1)), b(floatexp(0)), c(floatexp(0));
+    for (std::size_t n = 0; n != v.size() && norm(b) < norm(a) * limit; ++n)
+    {
+        orbit.a.push_back(a);
+        orbit.b.push_back(b);
+        orbit.c.push_back(c);
+        complexfe xn = v[n];
+        complexfe next_a = xn * a + complexfe(floatexp(1));
+        complexfe next_b = xn * b + a * a;
+        c = xn * c + complexfe(floatexp(2)) * a * b;
+        a = next_a;
+        b = next_b;
+    }
+}
+
+// high precision point used for perturbation theory method
+// produces a list of iteration values used to compute the surrounding points
+// the orbit is computed with the given number of bits, whatever the
+// precision of the center
+reference_orbit deep_zoom_point(const mpf_class &center_r,
+                                const mpf_class &center_i, int depth,
+                                mp_bitcnt_t bits,
+                                const std::atomic<bool> *cancel = nullptr)
+{
+    reference_orbit orbit;
+    orbit.bits = bits;
+    orbit_state state {mpf_class(center_r, bits), mpf_class(center_i, bits)};
+    orbit_buffer v(depth);
+    orbit.escaped = extend_orbit(center_r, center_i, depth, bits, v, state,
+                                 cancel);
+    if (!orbit.escaped)
+        orbit.end = std::make_shared<orbit_state>(std::move(state));
+    orbit.x = v.points();
+    series_coefficients(orbit);
+    return orbit;
+}
+
+// Give an orbit that stopped at its depth more iterations, going on from its
+// end. Nothing changes if it gets cancelled.
+void extend_reference(reference_orbit &orbit, const mpf_class &center_r,
+                      const mpf_class &center_i, int depth,
+                      const std::atomic<bool> *cancel = nullptr)
+{
+    orbit_buffer v(depth, orbit.x);
+    orbit_state state = *orbit.end;
+    bool escaped = extend_orbit(center_r, center_i, depth, orbit.bits, v,
+                                state, cancel);
+    if (cancel && *cancel)
+        return;
+
+    // the coefficients only need to go on if they went all the way before
+    bool series_done = orbit.a.size() < orbit.x.size();
+    orbit.x = v.points();
+    orbit.escaped = escaped;
+    orbit.end.reset();
+    if (!escaped)
+        orbit.end = std::make_shared<orbit_state>(std::move(state));
+    if (!series_done)
+    {
+        orbit.a.clear();
+        orbit.b.clear();
+        orbit.c.clear();
+        series_coefficients(orbit);
+    }
+}
+
+// Reference points
+
+// Newton's method gives up on a nucleus after this many steps
+const int newton_steps = 64;
+
+// z and dz/dc of the orbit of c, n iterations on from z = dz = 0, as floatexp
+// with z computed in full precision. Returns false if cancelled.
+bool orbit_derivative(mpf_srcptr c_r, mpf_srcptr c_i, int n, mp_bitcnt_t bits,
+                      complexfe &z, complexfe &dz,
+                      const std::atomic<bool> *cancel)
+{
+    mpf_t z_r, z_i, sq_r, sq_i, sum;
+    mpf_t *registers[] = {&z_r, &z_i, &sq_r, &sq_i, &sum};
+    for (mpf_t *r : registers)
+        mpf_init2(*r, bits);
+    z = dz = complexfe(floatexp(0));
+    for (int k = 0; k != n; ++k)
+    {
+        if (cancel && k % 4096 == 0 && *cancel)
+            break;
+        // dz_k+1 = 2 z_k dz_k + 1
+        dz = complexfe(floatexp(2)) * z * dz + complexfe(floatexp(1));
+        mandelbrot_step(z_r, z_i, c_r, c_i, sq_r, sq_i, sum);
+        z = complexfe(floatexp::from_mpf(z_r), floatexp::from_mpf(z_i));
+    }
+    for (mpf_t *r : registers)
+        mpf_clear(*r);
+    return !(cancel && *cancel);
+}
+
+// The lowest period a nucleus within reach of the center can have: the first
+// n at which the disc of c within reach of the center, carried along the
+// orbit to first order, takes in 0, that is |z_n| < reach |dz_n/dc|. Returns
+// 0 if the orbit escapes or gets to depth first, or if cancelled.
+int ball_period(const mpf_class &center_r, const mpf_class &center_i,
+                const floatexp &reach, int depth, mp_bitcnt_t bits,
+                const std::atomic<bool> *cancel)
+{
+    mpf_t z_r, z_i, sq_r, sq_i, sum;
+    mpf_t *registers[] = {&z_r, &z_i, &sq_r, &sq_i, &sum};
+    for (mpf_t *r : registers)
+        mpf_init2(*r, bits);
+    floatexp reach2 = reach * reach;
+    complexfe z, dz;
+    int period = 0;
+    for (int n = 1; n <= depth && period == 0; ++n)
+    {
+        if (cancel && n % 4096 == 0 && *cancel)
+            break;
+        dz = complexfe(floatexp(2)) * z * dz + complexfe(floatexp(1));
+        mandelbrot_step(z_r, z_i, center_r.get_mpf_t(), center_i.get_mpf_t(),
+                        sq_r, sq_i, sum);
+        z = complexfe(floatexp::from_mpf(z_r), floatexp::from_mpf(z_i));
+        floatexp size = norm(z);
+        if (size > 4)
+            break;
+        if (size < reach2 * norm(dz))
+            period = n;
+    }
+    for (mpf_t *r : registers)
+        mpf_clear(*r);
+    return period;
+}
+
+// Look for the nucleus of the lowest period within reach of the center, up
+// to depth, and put it in nucleus_r and nucleus_i: the period comes from
+// ball_period, then Newton's method solves z_period(c) = 0 in full precision,
+// starting from the center. Returns the period, or 0 if there is no nucleus
+// in reach, Newton's method doesn't settle on one, or it got cancelled.
+int find_nucleus(const mpf_class &center_r, const mpf_class &center_i,
+                 const floatexp &reach, int depth, mp_bitcnt_t bits,
+                 mpf_class &nucleus_r, mpf_class &nucleus_i,
+                 const std::atomic<bool> *cancel = nullptr)
+{
+    int period = ball_period(center_r, center_i, reach, depth, bits, cancel);
+    if (period == 0)
+        return 0;
+
+    // each step moves c by z/dz, until that is far below the reach
+    mpf_class c_r(center_r, bits), c_i(center_i, bits), moved(0, bits);
+    floatexp tolerance = reach * floatexp::normalise(1, -48);
+    for (int step = 0; step != newton_steps; ++step)
+    {
+        complexfe z, dz;
+        if (!orbit_derivative(c_r.get_mpf_t(), c_i.get_mpf_t(), period, bits,
+                              z, dz, cancel))
+            return 0;
+        floatexp size = norm(dz);
+        if (!(size > 0))
+            return 0;
+        complexfe delta((z.re * dz.re + z.im * dz.im) / size,
+                        (z.im * dz.re - z.re * dz.im) / size);
+        c_r -= delta.re.get_mpf(bits);
+        c_i -= delta.im.get_mpf(bits);
+        if (norm(delta) < tolerance * tolerance)
+        {
+            // Newton's method can wander off to a nucleus of the same
+            // period outside the disc
+            moved = c_r - center_r;
+            floatexp d_r = floatexp::from_mpf(moved);
+            moved = c_i - center_i;
+            floatexp d_i = floatexp::from_mpf(moved);
+            if (d_r * d_r + d_i * d_i > reach * reach)
+                return 0;
+            nucleus_r.set_prec(bits);
+            nucleus_i.set_prec(bits);
+            nucleus_r = c_r;
+            nucleus_i = c_i;
+            return period;
+        }
+    }
+    return 0;
+}
+
+// The orbit cache
+
+// an mpf value as exact text: base 16 digits, and a power of two after the @
+std::string mpf_text(const mpf_class &x)
+{
+    mp_exp_t exp;
+    char *digits = mpf_get_str(nullptr, &exp, 16, 0, x.get_mpf_t());
+    std::string text = digits;
+    void (*release)(void *, size_t);
+    mp_get_memory_functions(nullptr, nullptr, &release);
+    release(digits, strlen(digits) + 1);
+
+    bool negative = !text.empty() && text[0] == '-';
+    if (negative)
+        text.erase(0, 1);
+    if (text.empty())
+        return "0";
+    // 0.digits * 16^exp
+    return (negative ? "-0." : "0.") + text + "@" + std::to_string(4 * exp);
+}
+
+mpf_class mpf_from_text(const std::string &text, mp_bitcnt_t bits)
+{
+    mpf_class x(0, bits);
+    size_t at = text.find('@');
+    if (at == std::string::npos)
+        return x;
+    x.set_str(text.substr(0, at), 16);
+    long exp = atol(text.c_str() + at + 1);
+    if (exp >= 0)
+        mpf_mul_2exp(x.get_mpf_t(), x.get_mpf_t(), exp);
+    else
+        mpf_div_2exp(x.get_mpf_t(), x.get_mpf_t(), -exp);
+    return x;
+}
+
+// orbits that take less than this to compute aren't worth the disk
+const double cache_min_seconds = 0.1;
+
+const char cache_magic[8] = "ANTORB1";
+
+// Reference orbits kept on disk between runs, one file per center and
+// precision. A file holds the points of the longest orbit asked for so far,
+// and is mapped straight into memory when it is used again: an orbit of
+// fewer points is a prefix of it, and a longer one goes on from the high
+// precision state saved at its end instead of from the start.
+class orbit_cache
+{
+public:
+    explicit orbit_cache(const std::string &directory) : directory(directory)
+    {
+        // make the directory and its parents
+        for (size_t slash = directory.find('/', 1);
+             slash != std::string::npos; slash = directory.find('/', slash + 1))
+            mkdir(directory.substr(0, slash).c_str(), 0755);
+        mkdir(directory.c_str(), 0755);
+    }
+
+    // the orbit of the center, from the cache when it can be
+    reference_orbit get(const mpf_class &center_r, const mpf_class &center_i,
+                        int depth, mp_bitcnt_t bits,
+                        const std::atomic<bool> *cancel = nullptr)
+    {
+        std::string key = key_text(center_r, center_i, bits);
+        std::string path = file_path(key);
+        reference_orbit orbit;
+        orbit.bits = bits;
+
+        std::shared_ptr<mapped_file> file(new mapped_file(path));
+        const header *h = check(*file, key);
+        if (h && (h->count >= (uint64_t) depth || h->escaped))
+        {
+            // zero copy, the points stay in the mapping
+            auto points = (const std::complex<double> *)
+                (file->bytes() + h->points);
+            orbit.x = orbit_points(file, points, h->count).prefix(depth);
+            orbit.escaped = h->escaped && h->count <= (uint64_t) depth;
+            if (!orbit.escaped && h->count == (uint64_t) depth)
+                orbit.end = std::make_shared<orbit_state>(saved_state(*file,
+                                                                      *h,
+                                                                      bits));
+            series_coefficients(orbit);
+            return orbit;
+        }
+
+        auto begin = std::chrono::steady_clock::now();
+        orbit_points saved;
+        orbit_state state {mpf_class(center_r, bits),
+                           mpf_class(center_i, bits)};
+        if (h)
+        {
+            // go on from the end of the shorter orbit
+            auto points = (const std::complex<double> *)
+                (file->bytes() + h->points);
+            saved = orbit_points(file, points, h->count);
+            state = saved_state(*file, *h, bits);
+        }
+        orbit_buffer v(depth, saved);
+        saved = orbit_points();
+        file.reset();
+        bool escaped = extend_orbit(center_r, center_i, depth, bits, v, state,
+                                    cancel);
+        double seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - begin).count();
+        orbit.x = v.points();
+        if (!(cancel && *cancel) && seconds >= cache_min_seconds)
+            save(path, key, orbit.x, state, escaped);
+
+        orbit.escaped = escaped;
+        if (!escaped)
+            orbit.end = std::make_shared<orbit_state>(std::move(state));
+        series_coefficients(orbit);
+        return orbit;
+    }
+
+private:
+    // The layout of a file: this header, the key and the saved state as
+    // text, then the points from offset points on.
+    struct header
+    {
+        char magic[8];
+        uint64_t bits;
+        uint64_t count;         // number of points
+        uint64_t escaped;       // the orbit ends with its last point
+        uint64_t key_size;
+        uint64_t state_size;
+        uint64_t points;
+    };
+
+    // the exact center and precision
+    static std::string key_text(const mpf_class &center_r,
+                                const mpf_class &center_i, mp_bitcnt_t bits)
+    {
+        return mpf_text(center_r) + " " + mpf_text(center_i) + " " +
+               std::to_string(bits);
+    }
+
+    // files are named after the 64 bit FNV-1a hash of the key
+    std::string file_path(const std::string &key) const
+    {
+        uint64_t hash = 14695981039346656037ULL;
+        for (unsigned char c : key)
+            hash = (hash ^ c) * 1099511628211ULL;
+        char name[32];
+        snprintf(name, sizeof name, "/%016llx.orbit",
+                 (unsigned long long) hash);
+        return directory + name;
+    }
+
+    // the high precision point after the last one of a file
+    static orbit_state saved_state(const mapped_file &file, const header &h,
+                                   mp_bitcnt_t bits)
+    {
+        std::istringstream saved(std::string(
+            file.bytes() + sizeof(header) + h.key_size, h.state_size));
+        std::string xn_r, xn_i;
+        saved >> xn_r >> xn_i;
+        return orbit_state {mpf_from_text(xn_r, bits),
+                            mpf_from_text(xn_i, bits)};
+    }
+
+    // the header of a file that really holds the orbit of key, or null
+    static const header *check(const mapped_file &file, const std::string &key)
+    {
+        if (!file.ok() || file.length < sizeof(header))
+            return nullptr;
+        const header *h = (const header *) file.bytes();
+        if (memcmp(h->magic, cache_magic, 8) != 0 ||
+            h->key_size != key.size() ||
+            sizeof(header) + h->key_size + h->state_size > h->points ||
+            h->points + h->count * sizeof(std::complex<double>) > file.length ||
+            memcmp(file.bytes() + sizeof(header), key.data(), key.size()) != 0)
+            return nullptr;
+        return h;
+    }
+
+    // Write the file next to its final place and move it there, so that
+    // nobody ever maps half a file, even with several renderers on one cache.
+    static void save(const std::string &path, const std::string &key,
+                     const orbit_points &v, const orbit_state &state,
+                     bool escaped)
+    {
+        std::string saved = mpf_text(state.xn_r) + " " + mpf_text(state.xn_i);
+        header h;
+        memcpy(h.magic, cache_magic, 8);
+        h.bits = state.xn_r.get_prec();
+        h.count = v.size();
+        h.escaped = escaped;
+        h.key_size = key.size();
+        h.state_size = saved.size();
+        // keep the points aligned for the kernels
+        h.points = (sizeof h + key.size() + saved.size() + 63) / 64 * 64;
+
+        std::string temporary = path + "." + std::to_string(getpid());
+        {
+            std::ofstream out(temporary, std::ios::binary);
+            out.write((const char *) &h, sizeof h);
+            out << key << saved;
+            out << std::string(h.points - sizeof h - key.size() - saved.size(),
+                               '\0');
+            out.write((const char *) v.data(),
+                      v.size() * sizeof(std::complex<double>));
+            if (!out)
+            {
+                out.close();
+                remove(temporary.c_str());
+                return;
+            }
+        }
+        rename(temporary.c_str(), path.c_str());
+    }
+
+    std::string directory;
+};
+
+// The cache in $ANTELBROT_CACHE, or in ~/.cache/antelbrot. Setting
+// ANTELBROT_CACHE to the empty string turns the cache off.
+std::unique_ptr<orbit_cache> open_orbit_cache()
+{
+    const char *dir = getenv("ANTELBROT_CACHE");
+    const char *home = getenv("HOME");
+    std::string directory = dir ? dir :
+        home ? std::string(home) + "/.cache/antelbrot" : "";
+    if (directory.empty())
+        return nullptr;
+    return std::unique_ptr<orbit_cache>(new orbit_cache(directory));
+}
+
+// Find how many iterations every pixel can skip. Each probe (normally the
+// corners and edges of the frame, which are furthest from the reference) is
+// iterated directly and compared with the series; the skip is the last
+// iteration where the series still agrees with all of them.
+series_step series_skip(const reference_orbit &orbit,
+                        const vector<complexfe> &probes, const floatexp &radius)
+{
+    // relative error allowed between the series and the real delta
+    const floatexp tolerance = 1e-8;
+
+    int skip = (int) orbit.a.size() - 1;
+    for (const complexfe &d0 : probes)
+    {
+        complexfe dn = d0;
+        for (int n = 0; n <= skip; ++n)
+        {
+            complexfe series = ((complexfe(orbit.c[n]) * d0 +
+                                 complexfe(orbit.b[n])) * d0 +
+                                complexfe(orbit.a[n])) * d0;
+            if (norm(series - dn) > tolerance * tolerance * norm(dn))
+            {
+                skip = n - 1;
+                break;
+            }
+            dn = dn * (complexfe(orbit.x[n]) + dn) + d0;
+        }
+    }
+
+    // leave at least one iteration to the kernels, and the bailout test where
+    // the reference gets to it (x is 2 X_n) to them as well
+    skip = std::min(skip, (int) orbit.x.size() - 1);
+    for (int n = 1; n <= skip; ++n)
+    {
+        if (std::norm(orbit.x[n]) >= 4 * 256)
+        {
+            skip = n - 1;
+            break;
+        }
+    }
+
+    series_step start;
+    start.skip = std::max(skip, 0);
+    start.a = start.skip ? complexfe(orbit.a[start.skip])
+                         : complexfe(floatexp(1));
+    start.b = start.skip ? complexfe(orbit.b[start.skip])
+                         : complexfe(floatexp(0));
+    start.c = start.skip ? complexfe(orbit.c[start.skip])
+                         : complexfe(floatexp(0));
+
+    complexfe r(radius);
+    complexfe ua = start.a * r;
+    complexfe ub = start.b * r * r;
+    complexfe uc = start.c * r * r * r;
+    start.ua = std::complex<double>(ua.re.get_d(), ua.im.get_d());
+    start.ub = std::complex<double>(ub.re.get_d(), ub.im.get_d());
+    start.uc = std::complex<double>(uc.re.get_d(), uc.im.get_d());
+    start.inv_radius = (floatexp(1) / radius).get_d();
+    return start;
+}
+
+// Bivariate linear approximation
+
+// Wherever dn is small next to X_n, the dn^2 term of the perturbation step
+// hardly matters, and a run of iterations is linear in dn and d0:
+// dn+l ~ a dn + b d0. A step like that holds while |dn| < r, and two steps
+// merge into one that covers both. The table keeps the merged steps of 2^l
+// iterations, for l from bla_min_level up, that start at multiples of 2^l, so
+// a pixel can jump as far as its dn allows at every iteration it reaches.
+template <typename R>
+struct bla_step
+{
+    complex_t<R> a, b;
+    R r;
+};
+
+// the largest |dn^2| / |X_n dn| a single step may leave out
+const double bla_epsilon = 1.0 / (1 << 24);
+
+// The shorter steps would take up 7/8 of the table, about as much memory
+// as the whole orbit again, and save little over iterating.
+const int bla_min_level = 3;
+
+template <typename R>
+struct bla_table
+{
+    // levels[l - bla_min_level] holds the steps of 2^l iterations
+    vector<vector<bla_step<R>>> levels;
+
+    // The longest step that starts at iter, ends by max_iter and holds for
+    // a delta of this norm, or null if there is none. A step that holds
+    // means the first half of it holds too, so the first one found from
+    // the top wins.
+    const bla_step<R> *find(int iter, const R &dn_norm, int max_iter,
+                            int *length) const
+    {
+        int top = bla_min_level + (int) levels.size() - 1;
+        int level = iter ? __builtin_ctz(iter) : top;
+        for (level = std::min(level, top); level >= bla_min_level; --level)
+        {
+            const vector<bla_step<R>> &steps = levels[level - bla_min_level];
+            size_t k = iter >> level;
+            if (k < steps.size() && iter + (1 << level) <= max_iter &&
+                dn_norm < steps[k].r * steps[k].r)
+            {
+                *length = 1 << level;
+                return &steps[k];
+            }
+        }
+        return nullptr;
+    }
+};
+
+// Run first, and then second. The merged step holds for the dn that first
+// takes to within the radius of second, for any |d0| up to max_d0. A step
+// that never holds (or, on double, would overflow) gets a radius of 0.
+template <typename R>
+bla_step<R> merge_steps(const bla_step<R> &first, const bla_step<R> &second,
+                        const R &max_d0)
+{
+    using std::sqrt;
+    bla_step<R> merged;
+    merged.r = 0;
+    if (!(first.r > R(0)) || !(second.r > R(0)))
+        return merged;
+    R r = (second.r - sqrt(norm(first.b)) * max_d0) / sqrt(norm(first.a));
+    if (!(r > R(0)))
+        return merged;
+    merged.a = second.a * first.a;
+    merged.b = second.a * first.b + second.b;
+    if (std::is_same<R, double>::value &&
+        (norm(merged.a) > R(1e300) || norm(merged.b) > R(1e300)))
+        return merged;
+    merged.r = (r < first.r) ? r : first.r;
+    return merged;
+}
+
+// Build the table over the whole orbit, for frames whose pixels are all
+// within max_d0 of the reference. A single step at n is dn -> x[n] dn + d0,
+// which holds while |dn| < bla_epsilon |x[n]|.
+template <typename R>
+bla_table<R> bla_steps(const orbit_points &x, const R &max_d0)
+{
+    auto single = [&](size_t n)
+    {
+        bla_step<R> step;
+        step.a = complex_t<R>(x[n]);
+        step.b = complex_t<R>(R(1));
+        step.r = R(bla_epsilon * std::abs(x[n]));
+        return step;
+    };
+    // the lowest level merges its single steps one by one
+    const size_t length = size_t(1) << bla_min_level;
+    bla_table<R> table;
+    vector<bla_step<R>> level(x.size() / length);
+    for (size_t k = 0; k != level.size(); ++k)
+    {
+        level[k] = single(k * length);
+        for (size_t n = 1; n != length; ++n)
+            level[k] = merge_steps(level[k], single(k * length + n), max_d0);
+    }
+    while (!level.empty())
+    {
+        vector<bla_step<R>> next(level.size() / 2);
+        for (size_t k = 0; k != next.size(); ++k)
+            next[k] = merge_steps(level[2 * k], level[2 * k + 1], max_d0);
+        table.levels.push_back(std::move(level));
+        level = std::move(next);
+    }
+    return table;
+}
+
+// Perturbation kernels
+
+// Where perturbation breaks down, the pixels around the reference collapse
+// onto it and come out as flat blobs. Pauldelbrot's criterion catches this:
+// once |Z + dn| gets much smaller than |Z|, the delta has lost its precision.
+// The kernels stop such pixels and report them as glitched.
+const double glitch_tolerance = 1e-6;   // on |Z + dn|^2 / |Z|^2
+const int glitched = -2;
+
+// A pixel inside the set is drawn towards an attracting cycle, and the
+// derivative dz_n/dz_k of its orbit shrinks towards 0 along the way, while
+// outside it grows without bound. A single close pass by 0 makes it tiny as
+// well, which exterior pixels next to a minibrot do at its period, so the
+// kernels only trust it over whole windows of iterations: dz starts again at 1
+// for each window, the windows double in length from interior_window (so that
+// they soon span the cycle), and a pixel is given up on once dz has ended two
+// windows in a row this small (on |dz|^2). Pixels that never get there carry
+// on to max_iter, and are not marked inside.
+const double interior_derivative = 1e-12;
+const int interior_window = 16;
+
+// the windows of the interior check of one pixel, or of a group of lanes that
+// step through the orbit together
+struct interior_windows
+{
+    int end, length = interior_window;
+
+    explicit interior_windows(int first) : end(first + interior_window) {}
+
+    // at or past the end of the window, moves on to the next one
+    bool over(int iter)
+    {
+        if (iter < end)
+            return false;
+        length = std::min(length * 2, 1 << 24);
+        end = iter + length;
+        return true;
+    }
+};
+
+// Every kernel iterates n pixels, given by their offsets (d0_r, d0_i) from the
+// reference point, against the reference orbit x. The pixels start at
+// iteration start.skip with their deltas taken from the series approximation.
+// For each pixel it writes the iteration it stopped at and |z|^2 at that
+// point; iter == max_iter means the pixel never escaped, and iter == glitched
+// that it has to be redone with another reference. A pixel the interior
+// check stopped gets max_iter with a |z|^2 of -1.
+
+// Deltas the kernels can take and leave: pixels that go on from an earlier
+// frame start at iteration start.skip from (from_r, from_i) instead of the
+// series, and every pixel that reaches max_iter leaves its final delta in
+// (to_r, to_i). Any of them may be null.
+template <typename R>
+struct kernel_deltas
+{
+    const R *from_r = nullptr, *from_i = nullptr;
+    R *to_r = nullptr, *to_i = nullptr;
+};
+
+typedef void (*kernel_fn)(const double *d0_r, const double *d0_i, int n,
+                          const std::complex<double> *x, int max_iter,
+                          const series_step &start, int *iter, double *zn_size,
+                          bool interior, const kernel_deltas<double> &deltas);
+
+// R is double for the normal path, or floatexp past the range of a double
+template <typename R>
+void kernel_scalar(const R *d0_r, const R *d0_i, int n,
+                   const std::complex<double> *x, int max_iter,
+                   const series_step &start, int *iter_out, double *zn_out,
+                   bool interior, const kernel_deltas<R> &deltas)
+{
+    for (int p = 0; p != n; ++p)
+    {
+        complex_t<R> d0(d0_r[p], d0_i[p]);
+        int iter = start.skip;
+        double zn_size = 0;
+        // run the iteration loop
+        complex_t<R> dn = d0;
+        if (deltas.from_r)
+            dn = complex_t<R>(deltas.from_r[p], deltas.from_i[p]);
+        else if (start.skip)
+            dn = complex_t<R>(series_delta(start, complexfe(d0)));
+        std::complex<double> dz = 1;
+        interior_windows windows(iter);
+        bool was_small = false;
+        while (true)
+        {
+            dn = dn * (complex_t<R>(x[iter]) + dn) + d0;
+            ++iter;
+            if (iter == max_iter)
+                break;
+            // z is never extended range, only the delta is
+            double zr = x[iter].real() * 0.5 + (double) dn.re;
+            double zi = x[iter].imag() * 0.5 + (double) dn.im;
+            zn_size = zr * zr + zi * zi;
+
+            // use bailout radius of 256 for smooth coloring.
+            if (zn_size >= 256)
+                break;
+            if (zn_size < glitch_tolerance * 0.25 * std::norm(x[iter]))
+            {
+                iter = glitched;
+                break;
+            }
+            if (interior)
+            {
+                dz *= std::complex<double>(2 * zr, 2 * zi);
+                if (windows.over(iter))
+                {
+                    bool small = std::norm(dz) < interior_derivative;
+                    if (small && was_small)
+                    {
+                        iter = max_iter;
+                        zn_size = -1;
+                        break;
+                    }
+                    was_small = small;
+                    dz = 1;
+                }
+            }
+        }
+        if (iter == max_iter && zn_size >= 0 && deltas.to_r)
+        {
+            deltas.to_r[p] = dn.re;
+            deltas.to_i[p] = dn.im;
+        }
+        iter_out[p] = iter;
+        zn_out[p] = zn_size;
+    }
+}
+
+// The extended range kernel doesn't go through floatexp for every operation.
+// The real and imaginary part of a delta share one exponent, so dn is kept as
+// a complex<double> times 2^scale and only rescaled when it drifts too far.
+template <>
+void kernel_scalar<floatexp>(const floatexp *d0_r, const floatexp *d0_i, int n,
+                             const std::complex<double> *x, int max_iter,
+                             const series_step &start, int *iter_out,
+                             double *zn_out, bool interior,
+                             const kernel_deltas<floatexp> &deltas)
+{
+    // 2^k as a double, or 0 below the double range
+    auto exp2i = [](int64_t k)
+    {
+        return k < -1022 ? 0.0 : floatexp::exp2i(std::min<int64_t>(k, 1023));
+    };
+    // split a complex floatexp into a complex<double> and a shared exponent
+    auto split = [&](const complexfe &z, int64_t &scale)
+    {
+        scale = std::max(z.re.e, z.im.e);
+        return std::complex<double>(z.re.m * exp2i(z.re.e - scale),
+                                    z.im.m * exp2i(z.im.e - scale));
+    };
+
+    for (int p = 0; p != n; ++p)
+    {
+        complexfe d0(d0_r[p], d0_i[p]);
+        int64_t d0_scale;
+        std::complex<double> d0_m = split(d0, d0_scale);
+
+        int iter = start.skip;
+        double zn_size = 0;
+        int64_t scale;
+        std::complex<double> dn;
+        if (deltas.from_r)
+            dn = split(complexfe(deltas.from_r[p], deltas.from_i[p]), scale);
+        else
+            dn = split(start.skip ? series_delta(start, d0) : d0, scale);
+        if (d0_scale > scale)
+        {
+            // keep dn on the larger exponent of the two
+            dn *= exp2i(scale - d0_scale);
+            scale = d0_scale;
+        }
+        // the factors only change when dn gets rescaled
+        double dn_factor = exp2i(scale);
+        double d0_factor = exp2i(d0_scale - scale);
+        std::complex<double> dz = 1;
+        interior_windows windows(iter);
+        bool was_small = false;
+        while (true)
+        {
+            // dn = dn * (x[iter] + dn) + d0, with dn scaled by 2^scale
+            dn *= x[iter] + dn * dn_factor;
+            dn += d0_m * d0_factor;
+
+            // keep the mantissa within 2^+-64, but never below d0's exponent
+            double size = std::max(std::fabs(dn.real()), std::fabs(dn.imag()));
+            if (size > 1.8446744073709552e19 ||
+                (size < 5.421010862427522e-20 && scale > d0_scale))
+            {
+                int k;
+                std::frexp(size, &k);
+                k = std::max<int64_t>(k, d0_scale - scale);
+                dn *= exp2i(-k);
+                scale += k;
+                dn_factor = exp2i(scale);
+                d0_factor = exp2i(d0_scale - scale);
+            }
+
+            ++iter;
+            if (iter == max_iter)
+                break;
+            std::complex<double> z = x[iter] * 0.5 + dn * dn_factor;
+            zn_size = std::norm(z);
+
+            // use bailout radius of 256 for smooth coloring.
+            if (zn_size >= 256)
+                break;
+            if (zn_size < glitch_tolerance * 0.25 * std::norm(x[iter]))
+            {
+                iter = glitched;
+                break;
+            }
+            if (interior)
+            {
+                dz *= 2.0 * z;
+                if (windows.over(iter))
+                {
+                    bool small = std::norm(dz) < interior_derivative;
+                    if (small && was_small)
+                    {
+                        iter = max_iter;
+                        zn_size = -1;
+                        break;
+                    }
+                    was_small = small;
+                    dz = 1;
+                }
+            }
+        }
+        if (iter == max_iter && zn_size >= 0 && deltas.to_r)
+        {
+            deltas.to_r[p] = floatexp::normalise(dn.real(), scale);
+            deltas.to_i[p] = floatexp::normalise(dn.imag(), scale);
+        }
+        iter_out[p] = iter;
+        zn_out[p] = zn_size;
+    }
+}
+
+// kernel_scalar with the jumps of a BLA table: at every iteration a pixel
+// takes the longest step that holds for its delta, and only iterates on its
+// own where none does. Jumps only happen where dn is far below X_n, so no
+// pixel can escape or glitch in the middle of one, and the checks are done
+// where it lands. The interior check multiplies dz by the step's a, which is
+// the derivative along the reference.
+//
+// If counts isn't null, the iterations the pixels went through and the
+// steps that took (jumps and single iterations) are added to it.
+struct bla_counts
+{
+    long iterations = 0, steps = 0;
+};
+
+template <typename R>
+void kernel_bla(const R *d0_r, const R *d0_i, int n,
+                const std::complex<double> *x, int max_iter,
+                const series_step &start, int *iter_out, double *zn_out,
+                bool interior, const kernel_deltas<R> &deltas,
+                const bla_table<R> &table, bla_counts *counts = nullptr)
+{
+    for (int p = 0; p != n; ++p)
+    {
+        complex_t<R> d0(d0_r[p], d0_i[p]);
+        int iter = start.skip;
+        double zn_size = 0;
+        complex_t<R> dn = d0;
+        if (deltas.from_r)
+            dn = complex_t<R>(deltas.from_r[p], deltas.from_i[p]);
+        else if (start.skip)
+            dn = complex_t<R>(series_delta(start, complexfe(d0)));
+        std::complex<double> dz = 1;
+        interior_windows windows(iter);
+        bool was_small = false;
+        int first = iter, reached;
+        long steps = 0;
+        while (true)
+        {
+            ++steps;
+            int length;
+            const bla_step<R> *jump = table.find(iter, norm(dn), max_iter,
+                                                 &length);
+            if (jump)
+            {
+                dn = jump->a * dn + jump->b * d0;
+                iter += length;
+            }
+            else
+            {
+                dn = dn * (complex_t<R>(x[iter]) + dn) + d0;
+                ++iter;
+            }
+            reached = iter;
+            if (iter == max_iter)
+                break;
+            double zr = x[iter].real() * 0.5 + (double) dn.re;
+            double zi = x[iter].imag() * 0.5 + (double) dn.im;
+            zn_size = zr * zr + zi * zi;
+            if (zn_size >= 256)
+                break;
+            if (zn_size < glitch_tolerance * 0.25 * std::norm(x[iter]))
+            {
+                iter = glitched;
+                break;
+            }
+            if (interior)
+            {
+                dz *= jump ? std::complex<double>((double) jump->a.re,
+                                                  (double) jump->a.im)
+                           : std::complex<double>(2 * zr, 2 * zi);
+                if (windows.over(iter))
+                {
+                    bool small = std::norm(dz) < interior_derivative;
+                    if (small && was_small)
+                    {
+                        iter = max_iter;
+                        zn_size = -1;
+                        break;
+                    }
+                    was_small = small;
+                    dz = 1;
+                }
+            }
+        }
+        if (iter == max_iter && zn_size >= 0 && deltas.to_r)
+        {
+            deltas.to_r[p] = dn.re;
+            deltas.to_i[p] = dn.im;
+        }
+        if (counts)
+        {
+            counts->iterations += reached - first;
+            counts->steps += steps;
+        }
+        iter_out[p] = iter;
+        zn_out[p] = zn_size;
+    }
+}
+
+// The SIMD kernels keep the real and imaginary parts of N pixels in separate
+// registers (V holds N values of type T, M is the matching mask type). All
+// lanes step through the orbit together and read the same x[iter]; a lane that
+// has escaped is masked out and keeps its final values until the whole group
+// is done. T is double, or float for the shallow frames that don't need more,
+// which fits twice the lanes in a register.
+template <typename T, typename V, typename M, int N>
+static inline __attribute__((always_inline))
+void kernel_lanes(const double *d0_r, const double *d0_i, int n,
+                  const std::complex<double> *x, int max_iter,
+                  const series_step &start, int *iter_out, double *zn_out,
+                  bool interior, const kernel_deltas<double> &deltas)
+{
+    for (int p = 0; p < n; p += N)
+    {
+        // pad the last group by repeating its final pixel
+        V cr, ci;
+        for (int lane = 0; lane != N; ++lane)
+        {
+            int k = std::min(p + lane, n - 1);
+            cr[lane] = d0_r[k];
+            ci[lane] = d0_i[k];
+        }
+        int lane_iter[N];
+        bool lane_inside[N];
+        for (int lane = 0; lane != N; ++lane)
+        {
+            lane_iter[lane] = max_iter;
+            lane_inside[lane] = false;
+        }
+
+        V dr = cr, di = ci;
+        if (deltas.from_r)
+        {
+            for (int lane = 0; lane != N; ++lane)
+            {
+                int k = std::min(p + lane, n - 1);
+                dr[lane] = deltas.from_r[k];
+                di[lane] = deltas.from_i[k];
+            }
+        }
+        else if (start.skip)
+        {
+            // dn = ((uc u + ub) u + ua) u with u = d0 / radius
+            T inv_radius = start.inv_radius;
+            T ua_r = start.ua.real(), ua_i = start.ua.imag();
+            T ub_r = start.ub.real(), ub_i = start.ub.imag();
+            T uc_r = start.uc.real(), uc_i = start.uc.imag();
+            V ur = cr * inv_radius;
+            V ui = ci * inv_radius;
+            dr = ur * uc_r - ui * uc_i + ub_r;
+            di = ur * uc_i + ui * uc_r + ub_i;
+            V tr = dr * ur - di * ui + ua_r;
+            V ti = dr * ui + di * ur + ua_i;
+            dr = tr * ur - ti * ui;
+            di = tr * ui + ti * ur;
+        }
+
+        V zn = cr * 0;
+        V dzr = zn + 1, dzi = zn;
+        interior_windows windows(start.skip);
+        M was_small = (cr != cr);   // all lanes off
+        M active = (cr == cr);   // all lanes on
+        int live = N;
+        for (int iter = start.skip; iter != max_iter;)
+        {
+            T xr = x[iter].real();
+            T xi = x[iter].imag();
+
+            // dn = dn * (x[iter] + dn) + d0
+            V tr = dr + xr;
+            V ti = di + xi;
+            V nr = dr * tr - di * ti + cr;
+            V ni = dr * ti + di * tr + ci;
+            dr = active ? nr : dr;
+            di = active ? ni : di;
+            ++iter;
+            if (iter == max_iter)
+                break;
+
+            T half_r = x[iter].real() * 0.5, half_i = x[iter].imag() * 0.5;
+            V zr = dr + half_r;
+            V zi = di + half_i;
+            V size = zr * zr + zi * zi;
+            zn = active ? size : zn;
+            T glitch_size = glitch_tolerance * 0.25 * std::norm(x[iter]);
+            M below = size < glitch_size, escaped = size >= 256;
+            // GCC folds the compares into the ands below as selects on a
+            // vector condition, which AVX-512 doesn't have, and falls back
+            // to comparing lane by lane. Keeping them apart avoids that.
+            if (sizeof(V) == 64)
+                asm("" : "+v"(below), "+v"(escaped));
+            M lost = active & below;
+            M done = (active & escaped) | lost;
+            M inside = done & 0;
+            if (interior)
+            {
+                // dz *= 2 z, only on the lanes still going: the others
+                // would carry on shrinking into denormals, which are slow
+                V nr = 2 * (dzr * zr - dzi * zi);
+                V ni = 2 * (dzr * zi + dzi * zr);
+                dzr = active ? nr : dzr;
+                dzi = active ? ni : dzi;
+                if (windows.over(iter))
+                {
+                    M small = dzr * dzr + dzi * dzi < (T) interior_derivative;
+                    inside = active & ~done & small & was_small;
+                    done |= inside;
+                    was_small = small;
+                    dzr = zn * 0 + 1;
+                    dzi = zn * 0;
+                }
+            }
+
+            // test the mask a word at a time rather than lane by lane
+            uint64_t words[sizeof(M) / 8];
+            std::memcpy(words, &done, sizeof words);
+            uint64_t any = 0;
+            for (uint64_t word : words)
+                any |= word;
+            if (any)
+            {
+                for (int lane = 0; lane != N; ++lane)
+                {
+                    if (done[lane])
+                    {
+                        lane_iter[lane] = lost[lane] ? glitched :
+                                          inside[lane] ? max_iter : iter;
+                        lane_inside[lane] = inside[lane] != 0;
+                        --live;
+                    }
+                }
+                active &= ~done;
+                if (live == 0)
+                    break;
+            }
+        }
+
+        for (int lane = 0; lane != N && p + lane < n; ++lane)
+        {
+            iter_out[p + lane] = lane_iter[lane];
+            zn_out[p + lane] = lane_inside[lane] ? -1 : zn[lane];
+            if (lane_iter[lane] == max_iter && !lane_inside[lane] &&
+                deltas.to_r)
+            {
+                deltas.to_r[p + lane] = dr[lane];
+                deltas.to_i[p + lane] = di[lane];
+            }
+        }
+    }
+}
+
+typedef double v4d __attribute__((vector_size(32)));
+typedef long long v4l __attribute__((vector_size(32)));
+typedef double v8d __attribute__((vector_size(64)));
+typedef long long v8l __attribute__((vector_size(64)));
+typedef float v8f __attribute__((vector_size(32)));
+typedef int v8i __attribute__((vector_size(32)));
+typedef float v16f __attribute__((vector_size(64)));
+typedef int v16i __attribute__((vector_size(64)));
+
+__attribute__((target("avx2,fma")))
+void kernel_avx2(const double *d0_r, const double *d0_i, int n,
+                 const std::complex<double> *x, int max_iter,
+                 const series_step &start, int *iter, double *zn_size,
+                 bool interior, const kernel_deltas<double> &deltas)
+{
+    kernel_lanes<double, v4d, v4l, 4>(d0_r, d0_i, n, x, max_iter, start, iter,
+                                      zn_size, interior, deltas);
+}
+
+__attribute__((target("avx2,fma")))
+void kernel_avx2_float(const double *d0_r, const double *d0_i, int n,
+                       const std::complex<double> *x, int max_iter,
+                       const series_step &start, int *iter, double *zn_size,
+                       bool interior, const kernel_deltas<double> &deltas)
+{
+    kernel_lanes<float, v8f, v8i, 8>(d0_r, d0_i, n, x, max_iter, start, iter,
+                                     zn_size, interior, deltas);
+}
+
+__attribute__((target("avx512f,avx512dq,fma")))
+void kernel_avx512(const double *d0_r, const double *d0_i, int n,
+                   const std::complex<double> *x, int max_iter,
+                   const series_step &start, int *iter, double *zn_size,
+                   bool interior, const kernel_deltas<double> &deltas)
+{
+    kernel_lanes<double, v8d, v8l, 8>(d0_r, d0_i, n, x, max_iter, start, iter,
+                                      zn_size, interior, deltas);
+}
+
+__attribute__((target("avx512f,avx512dq,fma")))
+void kernel_avx512_float(const double *d0_r, const double *d0_i, int n,
+                         const std::complex<double> *x, int max_iter,
+                         const series_step &start, int *iter, double *zn_size,
+                         bool interior, const kernel_deltas<double> &deltas)
+{
+    kernel_lanes<float, v16f, v16i, 16>(d0_r, d0_i, n, x, max_iter, start,
+                                        iter, zn_size, interior, deltas);
+}
+
+// pick the widest kernel this cpu can run, on floats if single is set. The
+// scalar kernel gains nothing from floats, so it stays on double. Setting
+// ANTELBROT_KERNEL to avx2 or scalar holds the choice down to that kernel,
+// to compare them.
+kernel_fn select_kernel(std::string *name, bool single)
+{
+    const char *limit = getenv("ANTELBROT_KERNEL");
+    std::string widest = limit ? limit : "avx512";
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq")
+        && widest == "avx512")
+    {
+        *name = "avx512";
+        return single ? kernel_avx512_float : kernel_avx512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") &&
+        widest != "scalar")
+    {
+        *name = "avx2";
+        return single ? kernel_avx2_float : kernel_avx2;
+    }
+    *name = "scalar";
+    return kernel_scalar<double>;
+}
+
+// the kernels used for rendering, chosen once at startup
+std::string kernel_name;
+const kernel_fn iterate = select_kernel(&kernel_name, false);
+const kernel_fn iterate_float = select_kernel(&kernel_name, true);
+
+// the complex offset of twice the pixel distance (di2, dj2)
+template <typename R>
+complex_t<R> pixel_offset(int di2, int dj2, const sf::Vector2u &size,
+                          const R &radius)
+{
+    int window_radius = (size.x < size.y) ? size.x : size.y;
+    return complex_t<R>(radius * R(di2) / R(window_radius),
+                        -radius * R(dj2) / R(window_radius));
+}
+
+// find the offset from the center of the frame to the center of pixel (i,j),
+// or from a reference that the center is shift radii away from
+template <typename R>
+complex_t<R> pixel_delta(int i, int j, const sf::Vector2u &size, const R &radius,
+                         const std::complex<double> &shift = 0)
+{
+    complex_t<R> d = pixel_offset(2 * i - (int) size.x, 2 * j - (int) size.y,
+                                  size, radius);
+    if (shift == std::complex<double>(0))
+        return d;
+    return complex_t<R>(d.re + radius * R(shift.real()),
+                        d.im + radius * R(shift.imag()));
+}
+
+// send rows of pixels to the kernel for their real type, on floats if single
+// is set and the frame is double
+inline void run_kernel(const double *d0_r, const double *d0_i, int n,
+                       const std::complex<double> *x, int max_iter,
+                       const series_step &start, int *iter, double *zn_size,
+                       bool interior, bool single,
+                       const kernel_deltas<double> &deltas =
+                           kernel_deltas<double>(),
+                       const bla_table<double> *bla = nullptr)
+{
+    if (bla)
+        kernel_bla<double>(d0_r, d0_i, n, x, max_iter, start, iter, zn_size,
+                           interior, deltas, *bla);
+    else
+        (single ? iterate_float : iterate)(d0_r, d0_i, n, x, max_iter, start,
+                                           iter, zn_size, interior, deltas);
+}
+
+// (there are no float kernels for extended range)
+inline void run_kernel(const floatexp *d0_r, const floatexp *d0_i, int n,
+                       const std::complex<double> *x, int max_iter,
+                       const series_step &start, int *iter, double *zn_size,
+                       bool interior, bool /* single */,
+                       const kernel_deltas<floatexp> &deltas =
+                           kernel_deltas<floatexp>(),
+                       const bla_table<floatexp> *bla = nullptr)
+{
+    if (bla)
+        kernel_bla<floatexp>(d0_r, d0_i, n, x, max_iter, start, iter, zn_size,
+                             interior, deltas, *bla);
+    else
+        kernel_scalar<floatexp>(d0_r, d0_i, n, x, max_iter, start, iter,
+                                zn_size, interior, deltas);
+}
+
+// Past this radius the pixel deltas get too close to the bottom of the double
+// range, and the renderer switches to floatexp.
+const double extended_radius = 1e-280;
+
+// The float kernels round every point x_n of the reference orbit to within
+// FLT_EPSILON |x_n|, and the errors that leaves in the pixels add up roughly
+// like a random walk over the iterations. While that stays single_margin
+// times below a pixel, they give the same picture as the double ones but for
+// a scattering of pixels on the filaments, where the orbit is chaotic enough
+// that double only gets them right by being lucky too. Past it, the errors
+// grow to the size of a pixel and whole bands of escape counts shift.
+const double single_margin = 128;
+
+// whether a frame of the given size can go through the float kernels, from
+// the size of its pixels and the largest point of the orbit it will use
+bool single_enough(const reference_orbit &orbit, const floatexp &radius,
+                   const sf::Vector2u &size, const series_step &start,
+                   int max_iter)
+{
+    if (!(radius > extended_radius))
+        return false;
+    double pixel = 2 * radius.get_d() / std::min(size.x, size.y);
+    // the squares of the deltas have to stay normal floats as well
+    if (pixel * pixel < FLT_MIN / FLT_EPSILON)
+        return false;
+    // the orbit can stop short of max_iter
+    int end = std::min<size_t>(max_iter, orbit.x.size());
+    double steps = std::sqrt((double) std::max(end - start.skip, 1));
+    double largest = pixel / (single_margin * FLT_EPSILON * steps);
+    double limit = largest * largest;
+    for (int n = start.skip; n < end; ++n)
+        if (std::norm(orbit.x[n]) > limit)
+            return false;
+    return true;
+}
+
+// color a pixel from its iteration and smooth iteration count
+sf::Color pixel_color(const vector<sf::Color> &gradient, int iter, double nu,
+                      int max_iter)
+{
+    if (iter == max_iter)
+        return sf::Color::Black;    // if it's in the set, color black
+    if (iter < 0)
+        return sf::Color::Black;    // a glitch that isn't fixed yet
+
+    return palette(gradient, nu);
+}
+
+// the frame corners and edge midpoints, used to check the series
+vector<complexfe> frame_probes(const sf::Vector2u &size, const floatexp &radius,
+                               const std::complex<double> &shift)
+{
+    vector<complexfe> probes;
+    int w = size.x, h = size.y;
+    int xs[] = {0, w / 2, w - 1};
+    int ys[] = {0, h / 2, h - 1};
+    for (int i : xs)
+        for (int j : ys)
+            if (i != w / 2 || j != h / 2)
+                probes.push_back(pixel_delta(i, j, size, radius, shift));
+    return probes;
+}
+
+// The final deltas of the pixels that reached max_iter against the frame's
+// own reference, so that a deeper frame of the same view can go on from where
+// they stopped. Each delta is (re + i im) * 2^exp, and exp is no_delta for a
+// pixel that has none.
+struct pixel_deltas
+{
+    vector<double> re, im;
+    vector<int32_t> exp;
+};
+
+const int32_t no_delta = INT32_MIN;
+
+// a pixel that goes on from its delta at iteration resume_from
+const int resumable = -3;
+
+// the nu of a pixel at max_iter that an interior check has found inside
+const float known_inside = -1;
+
+// Where the time of a frame went, and what its pixels came to. The pixel
+// counts are of the finished picture, copied pixels included.
+// Counts of the pixels whose results are final. Every task keeps its own as
+// it stores them, and they are added up once the pool is done with the
+// tasks, so that the stats never need a pass over the frame.
+struct pixel_counts
+{
+    double iterations = 0;      // over the escaped pixels
+    int escaped = 0, inside = 0, max_iter = 0;
+
+    // a pixel of a frame of depth max_iter (glitches aren't final)
+    void add(int iter, int depth)
+    {
+        if (iter == depth)
+            ++inside;
+        else if (iter >= 0)
+        {
+            ++escaped;
+            iterations += iter;
+            max_iter = std::max(max_iter, iter);
+        }
+    }
+
+    void add(const pixel_counts &counts)
+    {
+        iterations += counts.iterations;
+        escaped += counts.escaped;
+        inside += counts.inside;
+        max_iter = std::max(max_iter, counts.max_iter);
+    }
+};
+
+struct frame_stats
+{
+    double orbit_seconds = 0;   // 0 when the orbit was kept from before
+    int period = 0;             // of the nucleus used as the reference, or 0
+    int depth = 0;              // the depth the frame was asked for
+    double frame_seconds = 0;
+    double pixel_seconds = 0;   // of it, on computing the pixels
+    double glitch_seconds = 0;  // and on fixing their glitches
+    int skip = 0;               // iterations the series skipped
+    double bla_gain = 0;        // iterations per BLA step, 0 without BLA
+    double mean_iter = 0;       // over the pixels that escaped
+    int max_iter = 0;           // highest iteration a pixel escaped at
+    double inside = 0;          // fraction of pixels that reached max_iter
+    int glitches = 0;           // pixels the main reference got wrong
+    int references = 0;         // secondary references used to fix them
+    int filled = 0;             // glitches left to fill from a neighbour
+};
+
+// The iteration results of every pixel of a frame, kept next to the colors so
+// that later frames can reuse them. iter is -1 for a pixel that hasn't been
+// computed yet, glitched for one that needs another reference, and resumable
+// for one that goes on from an earlier frame. The deltas are only kept when
+// asked for.
+struct frame
+{
+    sf::Vector2u size;
+    int max_iter = 0;
+    vector<int> iter;
+    vector<float> nu;   // smooth iteration count of the escaped pixels
+    pixel_deltas deltas;
+    int resume_from = 0;
+    bool interior_checks = true;
+    bool subdivide = false;     // Mariani-Silver instead of the passes
+    bool single = false;        // float kernels, for shallow frames
+    int aa_grid = 0;            // aa_grid^2 samples on edges, 0 for none
+    bool keep_glitches = false; // for whoever has the whole image to fix
+
+    // the offset of the center from the reference orbit, in units of the
+    // radius. The deltas are against the reference.
+    std::complex<double> shift;
+
+    // the averaged colors of the pixels that got extra samples, and
+    // transparent for the rest. Empty without anti-aliasing.
+    vector<sf::Color> aa;
+
+    // the samples behind aa: aa_grid^2 of them for each pixel of aa_pixels in
+    // turn, with their iteration and smooth iteration count, so that a new
+    // gradient can average them again
+    vector<int> aa_pixels, aa_iter;
+    vector<float> aa_nu;
+
+    // 1 for the glitches that only got a neighbour's result, which later
+    // frames compute again rather than copy. Empty if there are none.
+    vector<char> filled;
+
+    pixel_counts counts;
+    frame_stats stats;
+
+    frame() {}
+    frame(const sf::Vector2u &size, int max_iter, bool keep_deltas = false)
+        : size(size), max_iter(max_iter), iter(size.x * size.y, -1),
+          nu(size.x * size.y, 0)
+    {
+        if (keep_deltas)
+        {
+            deltas.re.resize(iter.size());
+            deltas.im.resize(iter.size());
+            deltas.exp.assign(iter.size(), no_delta);
+        }
+    }
+};
+
+// keep the delta of a pixel that reached max_iter, if the frame keeps them
+inline void store_delta(frame &pixels, int index, double re, double im)
+{
+    pixels.deltas.re[index] = re;
+    pixels.deltas.im[index] = im;
+    pixels.deltas.exp[index] = 0;
+}
+
+inline void store_delta(frame &pixels, int index, const floatexp &re,
+                        const floatexp &im)
+{
+    // put both parts on the larger exponent
+    int64_t e = std::max(re.e, im.e);
+    if (e == floatexp::zero_exp)
+        e = 0;
+    pixels.deltas.re[index] = std::ldexp(re.m, re.e - e);
+    pixels.deltas.im[index] = std::ldexp(im.m, im.e - e);
+    pixels.deltas.exp[index] = e;
+}
+
+inline void load_delta(const frame &pixels, int index, double &re, double &im)
+{
+    re = pixels.deltas.re[index];
+    im = pixels.deltas.im[index];
+}
+
+inline void load_delta(const frame &pixels, int index, floatexp &re,
+                       floatexp &im)
+{
+    re = floatexp::normalise(pixels.deltas.re[index], pixels.deltas.exp[index]);
+    im = floatexp::normalise(pixels.deltas.im[index], pixels.deltas.exp[index]);
+}
+
+// side length of the square tiles handed to the thread pool
+const int tile_size = 32;
+
+// Frames are rendered progressively. The first pass computes every 8th pixel
+// in each direction, and every pass after that halves the spacing. A pass
+// only computes the pixels of its grid that no earlier pass did, and paints
+// each one over its whole block until a finer pass fills the block in.
+const int first_step = 8;
+
+// The picture in the window, as RGBA bytes for its texture. The render
+// threads paint into it and mark the rows they touch, and the window uploads
+// only the bands of marked rows each time it draws.
+class framebuffer
+{
+public:
+    explicit framebuffer(const sf::Vector2u &size) { resize(size); }
+
+    // only while nothing paints into it
+    void resize(const sf::Vector2u &new_size)
+    {
+        size = new_size;
+        rgba.assign(4 * (size_t) size.x * size.y, 0);
+        for (size_t k = 3; k < rgba.size(); k += 4)
+            rgba[k] = 255;
+        dirty.reset(new std::atomic<bool>[size.y]);
+        for (unsigned j = 0; j != size.y; ++j)
+            dirty[j] = true;
+    }
+
+    const sf::Vector2u &get_size() const { return size; }
+
+    // fill the pixels from (i0,j0) up to (i1,j1) with color
+    void paint(int i0, int j0, int i1, int j1, const sf::Color &color)
+    {
+        for (int j = j0; j != j1; ++j)
+        {
+            sf::Uint8 *p = &rgba[4 * (i0 + (size_t) size.x * j)];
+            for (int i = i0; i != i1; ++i, p += 4)
+            {
+                p[0] = color.r;
+                p[1] = color.g;
+                p[2] = color.b;
+            }
+            dirty[j].store(true, std::memory_order_relaxed);
+        }
+    }
+
+    // set every pixel of row j, to color(i) for pixel i
+    template <typename F>
+    void paint_row(int j, F color)
+    {
+        sf::Uint8 *p = &rgba[4 * (size_t) size.x * j];
+        for (int i = 0; i != (int) size.x; ++i, p += 4)
+        {
+            sf::Color c = color(i);
+            p[0] = c.r;
+            p[1] = c.g;
+            p[2] = c.b;
+        }
+        dirty[j].store(true, std::memory_order_relaxed);
+    }
+
+    // copy the rows painted since the last upload into the texture, which
+    // must have the size of the buffer. Rows are whole, so a band of them is
+    // one contiguous update.
+    void upload(sf::Texture &texture)
+    {
+        unsigned j = 0;
+        while (j != size.y)
+        {
+            if (!dirty[j].exchange(false))
+            {
+                ++j;
+                continue;
+            }
+            unsigned first = j++;
+            while (j != size.y && dirty[j].exchange(false))
+                ++j;
+            texture.update(&rgba[4 * (size_t) size.x * first], size.x,
+                           j - first, 0, first);
+        }
+    }
+
+private:
+    sf::Vector2u size;
+    vector<sf::Uint8> rgba;
+    std::unique_ptr<std::atomic<bool>[]> dirty;
+};
+
+// Keep a kernel result in the frame. A glitched pixel keeps log2 |z|^2 from
+// the point it was stopped at instead of a smooth iteration count, as the
+// pixel that came closest to the reference makes the best next one. A pixel
+// known to be inside keeps known_inside, and stays inside at any depth. nu is
+// the smooth iteration count, if the caller has it already.
+void store_pixel(frame &pixels, int index, int iter, double zn_size, float nu)
+{
+    pixels.iter[index] = iter;
+    if (iter == glitched)
+        pixels.nu[index] = std::log2(zn_size);
+    else if (iter != pixels.max_iter)
+        pixels.nu[index] = nu;
+    else if (zn_size < 0)
+        pixels.nu[index] = known_inside;
+}
+
+void store_pixel(frame &pixels, int index, int iter, double zn_size)
+{
+    store_pixel(pixels, index, iter, zn_size,
+                iter >= 0 && iter != pixels.max_iter ?
+                smooth_iter(zn_size, iter) : 0);
+}
+
+// The kernels can only take a frame as far as its reference orbit goes,
+// which is short of max_iter when the reference escapes. The pixels still
+// going where it ends haven't been decided, so they become glitches, for
+// fix_glitches to take further on references of their own, rather than
+// being painted as inside.
+inline int orbit_iterations(const frame &pixels, const reference_orbit &orbit)
+{
+    return std::min<size_t>(pixels.max_iter, orbit.x.size());
+}
+
+// turn the results of n pixels that a kernel took up to end (from
+// orbit_iterations) into the frame's: the ones still going at end are
+// glitched, and the ones an interior check stopped are at max_iter. The
+// glitches keep |z|^2 at end, so that the one furthest from escaping there
+// becomes the next reference.
+inline void finish_at_orbit_end(const frame &pixels, int end, int *iter,
+                                const double *zn_size, int n)
+{
+    if (end == pixels.max_iter)
+        return;
+    for (int k = 0; k != n; ++k)
+        if (iter[k] == end)
+            iter[k] = zn_size[k] < 0 ? pixels.max_iter : glitched;
+}
+
+// color the block of step x step pixels at (pi,pj) from the pixel's iteration.
+// Without a framebuffer only the frame gets the results.
+void paint_block(framebuffer *set, const frame &pixels,
+                 const vector<sf::Color> &gradient, int pi, int pj, int step)
+{
+    if (!set)
+        return;
+    const sf::Vector2u &size = pixels.size;
+    int index = pi + size.x * pj;
+    sf::Color color = pixel_color(gradient, pixels.iter[index],
+                                  pixels.nu[index], pixels.max_iter);
+    int block_i = std::min(pi + step, (int) size.x);
+    int block_j = std::min(pj + step, (int) size.y);
+    set->paint(pi, pj, block_i, block_j, color);
+}
+
+// Points in the main cardioid or the period 2 bulb are inside the set, which
+// a test on c shows without iterating.
+inline bool in_main_bulbs(const std::complex<double> &c)
+{
+    double x = c.real() - 0.25, y2 = c.imag() * c.imag();
+    double q = x * x + y2;
+    if (q * (q + x) <= 0.25 * y2)
+        return true;
+    return (c.real() + 1) * (c.real() + 1) + y2 <= 0.0625;
+}
+
+// the bulb tests need c in double at about pixel precision, so they are only
+// used on frames of at least this radius
+const double bulb_test_radius = 1e-10;
+
+// Collects pixels for the kernel in groups of tile_size, then stores their
+// results in the frame and paints each one over a block of step pixels.
+// Pixels the bulb tests find inside never go to the kernel.
+template <typename R>
+class pixel_batch
+{
+public:
+    pixel_batch(framebuffer *set, frame &pixels,
+                const reference_orbit &orbit, const R &radius,
+                const series_step &start, const bla_table<R> *bla,
+                const vector<sf::Color> &gradient, int step,
+                const std::atomic<bool> &cancel)
+        : set(set), pixels(pixels), orbit(orbit), radius(radius),
+          start(start), bla(bla), gradient(gradient), step(step),
+          cancel(cancel)
+    {
+        // the reference is c = x[0] / 2, exact enough for the bulb tests
+        // while the frame is shallow
+        bulbs = pixels.interior_checks && (double) radius > bulb_test_radius;
+        if (!pixels.deltas.exp.empty())
+        {
+            deltas.to_r = dn_r;
+            deltas.to_i = dn_i;
+        }
+    }
+
+    ~pixel_batch() { flush(); }
+
+    void paint(int i, int j)
+    {
+        paint_block(set, pixels, gradient, i, j, step);
+    }
+
+    void add(int i, int j)
+    {
+        const sf::Vector2u &size = pixels.size;
+        complex_t<R> d0 = pixel_delta(i, j, size, radius, pixels.shift);
+        if (bulbs && in_main_bulbs(orbit.x[0] * 0.5 + std::complex<double>(
+                                       (double) d0.re, (double) d0.im)))
+        {
+            store_pixel(pixels, i + size.x * j, pixels.max_iter, -1);
+            counts.add(pixels.max_iter, pixels.max_iter);
+            paint(i, j);
+            return;
+        }
+        d0_r[n] = d0.re;
+        d0_i[n] = d0.im;
+        px[n] = i;
+        py[n] = j;
+        if (++n == tile_size)
+            flush();
+    }
+
+    void flush()
+    {
+        if (n == 0 || cancel)
+        {
+            n = 0;
+            return;
+        }
+        int max_iter = orbit_iterations(pixels, orbit);
+        run_kernel(d0_r, d0_i, n, orbit.x.data(), max_iter, start, iter,
+                   zn_size, pixels.interior_checks, pixels.single, deltas,
+                   bla);
+        finish_at_orbit_end(pixels, max_iter, iter, zn_size, n);
+        float nu[tile_size];
+        smooth_iters(iter, zn_size, n, nu);
+        for (int k = 0; k != n; ++k)
+        {
+            int index = px[k] + pixels.size.x * py[k];
+            // the subdivision can add a pixel twice, on lines rectangles share
+            if (pixels.iter[index] < 0)
+                counts.add(iter[k], pixels.max_iter);
+            store_pixel(pixels, index, iter[k], zn_size[k], nu[k]);
+            if (deltas.to_r && iter[k] == pixels.max_iter && zn_size[k] >= 0)
+                store_delta(pixels, index, dn_r[k], dn_i[k]);
+            paint(px[k], py[k]);
+        }
+        n = 0;
+    }
+
+    // the pixels this batch has finished
+    pixel_counts counts;
+
+private:
+    framebuffer *set;
+    frame &pixels;
+    const reference_orbit &orbit;
+    const R &radius;
+    const series_step &start;
+    const bla_table<R> *bla;
+    const vector<sf::Color> &gradient;
+    int step;
+    const std::atomic<bool> &cancel;
+    bool bulbs;
+
+    R d0_r[tile_size], d0_i[tile_size];
+    R dn_r[tile_size], dn_i[tile_size];
+    double zn_size[tile_size];
+    int iter[tile_size], px[tile_size], py[tile_size];
+    int n = 0;
+    kernel_deltas<R> deltas;
+};
+
+// whether a pixel only has a neighbour's result
+inline bool was_filled(const frame &pixels, int index)
+{
+    return !pixels.filled.empty() && pixels.filled[index];
+}
+
+// whether the frame still has to compute a pixel
+inline bool unknown(const frame &pixels, int i, int j)
+{
+    int iter = pixels.iter[i + pixels.size.x * j];
+    return iter < 0 && iter != resumable;
+}
+
+// Run one pass over one tile, and add the pixels it finished to counts.
+// Pixels the frame already has are only painted.
+template <typename R>
+void render_tile(framebuffer *set, frame &pixels,
+                 const reference_orbit &orbit, const R &radius,
+                 const series_step &start, const bla_table<R> *bla,
+                 const vector<sf::Color> &gradient, int tile_i, int tile_j,
+                 int step, const std::atomic<bool> &cancel,
+                 pixel_counts &counts)
+{
+    const sf::Vector2u &size = pixels.size;
+    int end_i = std::min(tile_i + tile_size, (int) size.x);
+    int end_j = std::min(tile_j + tile_size, (int) size.y);
+    pixel_batch<R> batch(set, pixels, orbit, radius, start, bla, gradient,
+                         step, cancel);
+
+    for (int j = tile_j; j < end_j; j += step)
+    {
+        for (int i = tile_i; i < end_i; i += step)
+        {
+            // skip the pixels an earlier pass already did
+            if (step != first_step && i % (2 * step) == 0 &&
+                j % (2 * step) == 0)
+                continue;
+
+            if (unknown(pixels, i, j))
+                batch.add(i, j);
+            else
+                batch.paint(i, j);
+        }
+    }
+    batch.flush();
+    counts.add(batch.counts);
+}
+
+// rectangles this small in either direction are computed in full
+const int smallest_rectangle = 4;
+
+// Mariani-Silver subdivision of one tile: compute the border of a rectangle,
+// and if the whole border has one iteration count, fill in the inside without
+// iterating it. Otherwise split the rectangle in four, sharing the middle
+// lines, and go on with each. The smooth iteration count of a filled pixel is
+// interpolated between the left and right border of its row. This can miss
+// detail that doesn't reach the border, so it is a mode of its own. All the
+// rectangles of one level compute their borders together, which keeps the
+// kernel calls full. The pixels it finished go into counts.
+template <typename R>
+void subdivide_tile(framebuffer *set, frame &pixels,
+                    const reference_orbit &orbit, const R &radius,
+                    const series_step &start, const bla_table<R> *bla,
+                    const vector<sf::Color> &gradient, int tile_i, int tile_j,
+                    const std::atomic<bool> &cancel, pixel_counts &counts)
+{
+    const sf::Vector2u &size = pixels.size;
+    int w = size.x;
+    pixel_batch<R> batch(set, pixels, orbit, radius, start, bla, gradient, 1,
+                         cancel);
+
+    struct rectangle { int x0, y0, x1, y1; };   // x1 and y1 are past the end
+    auto small = [](const rectangle &r)
+    {
+        return r.x1 - r.x0 <= smallest_rectangle ||
+               r.y1 - r.y0 <= smallest_rectangle;
+    };
+    vector<rectangle> level, next;
+    level.push_back(rectangle {tile_i, tile_j,
+                               std::min(tile_i + tile_size, (int) size.x),
+                               std::min(tile_j + tile_size, (int) size.y)});
+    while (!level.empty() && !cancel)
+    {
+        // the borders, or all of the small rectangles
+        for (const rectangle &r : level)
+        {
+            for (int j = r.y0; j != r.y1; ++j)
+            {
+                bool all = small(r) || j == r.y0 || j == r.y1 - 1;
+                for (int i = r.x0; i != r.x1;
+                     i += (all || i == r.x1 - 1) ? 1 : r.x1 - 1 - r.x0)
+                    if (unknown(pixels, i, j))
+                        batch.add(i, j);
+            }
+        }
+        batch.flush();
+        if (cancel)
+            return;
+
+        next.clear();
+        for (const rectangle &r : level)
+        {
+            if (small(r))
+                continue;
+
+            int iter = pixels.iter[r.x0 + w * r.y0];
+            bool same = iter >= 0;
+            for (int i = r.x0; i != r.x1 && same; ++i)
+                same = pixels.iter[i + w * r.y0] == iter &&
+                       pixels.iter[i + w * (r.y1 - 1)] == iter;
+            for (int j = r.y0; j != r.y1 && same; ++j)
+                same = pixels.iter[r.x0 + w * j] == iter &&
+                       pixels.iter[r.x1 - 1 + w * j] == iter;
+
+            if (same)
+            {
+                // an interior fill is known to be inside where all of its
+                // border is
+                float inside = 0;
+                if (iter == pixels.max_iter)
+                {
+                    inside = known_inside;
+                    for (int i = r.x0; i != r.x1 && inside; ++i)
+                        if (pixels.nu[i + w * r.y0] != known_inside ||
+                            pixels.nu[i + w * (r.y1 - 1)] != known_inside)
+                            inside = 0;
+                    for (int j = r.y0; j != r.y1 && inside; ++j)
+                        if (pixels.nu[r.x0 + w * j] != known_inside ||
+                            pixels.nu[r.x1 - 1 + w * j] != known_inside)
+                            inside = 0;
+                }
+                for (int j = r.y0 + 1; j != r.y1 - 1; ++j)
+                {
+                    float left = pixels.nu[r.x0 + w * j];
+                    float right = pixels.nu[r.x1 - 1 + w * j];
+                    for (int i = r.x0 + 1; i != r.x1 - 1; ++i)
+                    {
+                        int index = i + w * j;
+                        if (pixels.iter[index] != -1)
+                            continue;
+                        float t = float(i - r.x0) / (r.x1 - 1 - r.x0);
+                        pixels.iter[index] = iter;
+                        pixels.nu[index] = iter == pixels.max_iter ? inside :
+                                           left + (right - left) * t;
+                        batch.counts.add(iter, pixels.max_iter);
+                        batch.paint(i, j);
+                    }
+                }
+                continue;
+            }
+
+            // the middle lines are shared, so they are only computed once
+            int mx = (r.x0 + r.x1) / 2, my = (r.y0 + r.y1) / 2;
+            next.push_back(rectangle {r.x0, r.y0, mx + 1, my + 1});
+            next.push_back(rectangle {mx, r.y0, r.x1, my + 1});
+            next.push_back(rectangle {r.x0, my, mx + 1, r.y1});
+            next.push_back(rectangle {mx, my, r.x1, r.y1});
+        }
+        level.swap(next);
+    }
+    counts.add(batch.counts);
+}
+
+// The frame is split into tiles which the pool works through in parallel.
+// Every worker only reads the reference orbit, and writes to the pixels of
+// its own tile. Setting cancel makes the remaining tiles return at once.
+// Tiles either go through the progressive passes, or subdivide on their own.
+// Each tile counts the pixels it finishes on its own, and the counts go into
+// the frame's at the end.
+template <typename R>
+void render(framebuffer *set, frame &pixels,
+            const reference_orbit &orbit, const R &radius,
+            const series_step &start, const bla_table<R> *bla,
+            const vector<sf::Color> &gradient, thread_pool &pool,
+            const std::atomic<bool> &cancel)
+{
+    const sf::Vector2u &size = pixels.size;
+    int tiles_x = (size.x + tile_size - 1) / tile_size;
+    int tiles_y = (size.y + tile_size - 1) / tile_size;
+    vector<pixel_counts> counts(tiles_x * tiles_y);
+    if (pixels.subdivide)
+    {
+        task_group tiles;
+        for (int tile_j = 0; tile_j < (int) size.y; tile_j += tile_size)
+        {
+            for (int tile_i = 0; tile_i < (int) size.x; tile_i += tile_size)
+            {
+                pixel_counts &tile_counts =
+                    counts[tile_i / tile_size + tiles_x * (tile_j / tile_size)];
+                pool.submit(tiles, [=, &pixels, &orbit, &start, &radius,
+                                    &gradient, &cancel, &tile_counts]
+                {
+                    subdivide_tile<R>(set, pixels, orbit, radius, start,
+                                      bla, gradient, tile_i, tile_j, cancel,
+                                      tile_counts);
+                });
+            }
+        }
+        pool.wait(tiles);
+    }
+    for (int step = first_step; step >= 1 && !cancel && !pixels.subdivide;
+         step /= 2)
+    {
+        task_group tiles;
+        for (int tile_j = 0; tile_j < (int) size.y; tile_j += tile_size)
+        {
+            for (int tile_i = 0; tile_i < (int) size.x; tile_i += tile_size)
+            {
+                pixel_counts &tile_counts =
+                    counts[tile_i / tile_size + tiles_x * (tile_j / tile_size)];
+                pool.submit(tiles, [=, &pixels, &orbit, &start, &radius,
+                                    &gradient, &cancel, &tile_counts]
+                {
+                    render_tile<R>(set, pixels, orbit, radius, start, bla,
+                                   gradient, tile_i, tile_j, step, cancel,
+                                   tile_counts);
+                });
+            }
+        }
+        pool.wait(tiles);
+    }
+    for (const pixel_counts &c : counts)
+        pixels.counts.add(c);
+}
+
+// Go on with the resumable pixels from their deltas at resume_from, up to the
+// frame's max_iter. They are all at the same iteration, so they go through
+// the kernels like any other pixels, except that the check at resume_from
+// itself, which the earlier frame stopped short of, has to be done first.
+template <typename R>
+void resume(framebuffer *set, frame &pixels, const reference_orbit &orbit,
+            const R &radius, const bla_table<R> *bla,
+            const vector<sf::Color> &gradient, thread_pool &pool,
+            const std::atomic<bool> &cancel)
+{
+    vector<int> waiting;
+    for (int index = 0; index != (int) pixels.iter.size(); ++index)
+        if (pixels.iter[index] == resumable)
+            waiting.push_back(index);
+
+    const sf::Vector2u &size = pixels.size;
+    const std::complex<double> *x = orbit.x.data();
+    series_step start = series_step();
+    start.skip = pixels.resume_from;
+    if (start.skip >= (int) orbit.x.size())
+    {
+        // the orbit escaped before they got anywhere
+        for (int index : waiting)
+            store_pixel(pixels, index, glitched, INFINITY);
+        return;
+    }
+    vector<pixel_counts> counts((waiting.size() + tile_size - 1) / tile_size);
+    task_group chunks;
+    for (size_t first = 0; first < waiting.size(); first += tile_size)
+    {
+        pool.submit(chunks, [=, &pixels, &waiting, &orbit, &radius,
+                             &gradient, &cancel, &start, &counts]
+        {
+            if (cancel)
+                return;
+            pixel_counts &chunk_counts = counts[first / tile_size];
+            R d0_r[tile_size], d0_i[tile_size];
+            R from_r[tile_size], from_i[tile_size];
+            R dn_r[tile_size], dn_i[tile_size];
+            double zn_size[tile_size];
+            int iter[tile_size], px[tile_size];
+            int n = 0;
+            size_t end = std::min(first + tile_size, waiting.size());
+            for (size_t k = first; k != end; ++k)
+            {
+                int index = waiting[k];
+                R re, im;
+                load_delta(pixels, index, re, im);
+                std::complex<double> z = x[start.skip] * 0.5 +
+                    std::complex<double>((double) re, (double) im);
+                double size_z = std::norm(z);
+                if (size_z >= 256)
+                {
+                    store_pixel(pixels, index, start.skip, size_z);
+                    chunk_counts.add(start.skip, pixels.max_iter);
+                }
+                else if (size_z < glitch_tolerance * 0.25 *
+                                  std::norm(x[start.skip]))
+                    store_pixel(pixels, index, glitched, size_z);
+                else
+                {
+                    complex_t<R> d0 = pixel_delta(index % size.x,
+                                                   index / size.x, size,
+                                                   radius, pixels.shift);
+                    d0_r[n] = d0.re;
+                    d0_i[n] = d0.im;
+                    from_r[n] = re;
+                    from_i[n] = im;
+                    px[n++] = index;
+                    continue;
+                }
+                paint_block(set, pixels, gradient, index % size.x,
+                            index / size.x, 1);
+            }
+
+            kernel_deltas<R> deltas;
+            deltas.from_r = from_r;
+            deltas.from_i = from_i;
+            deltas.to_r = dn_r;
+            deltas.to_i = dn_i;
+            float nu[tile_size];
+            if (n != 0)
+            {
+                int max_iter = orbit_iterations(pixels, orbit);
+                run_kernel(d0_r, d0_i, n, x, max_iter, start, iter, zn_size,
+                           pixels.interior_checks, pixels.single, deltas,
+                           bla);
+                finish_at_orbit_end(pixels, max_iter, iter, zn_size, n);
+                smooth_iters(iter, zn_size, n, nu);
+            }
+            for (int k = 0; k != n; ++k)
+            {
+                store_pixel(pixels, px[k], iter[k], zn_size[k], nu[k]);
+                chunk_counts.add(iter[k], pixels.max_iter);
+                if (iter[k] == pixels.max_iter && zn_size[k] >= 0)
+                    store_delta(pixels, px[k], dn_r[k], dn_i[k]);
+                paint_block(set, pixels, gradient, px[k] % size.x,
+                            px[k] / size.x, 1);
+            }
+        });
+    }
+    pool.wait(chunks);
+    for (const pixel_counts &c : counts)
+        pixels.counts.add(c);
+}
+
+// The GPU kernel
+
+// The perturbation loop as an OpenGL compute shader, one invocation per pixel.
+// It does the same as the CPU kernels, with the same series start, bulb
+// tests, glitch and interior checks, and leaves the same final deltas. With
+// EXTENDED defined it keeps dn as a dvec2 times 2^scale, like
+// kernel_scalar<floatexp>, for the frames past extended_radius.
+const char gpu_kernel_source[] = R"(
+layout(local_size_x = 64) in;
+
+layout(std430, binding = 0) readonly buffer orbit_buffer { dvec2 x[]; };
+layout(std430, binding = 1) readonly buffer pixel_buffer { int pixel[]; };
+layout(std430, binding = 2) writeonly buffer iter_buffer { int iter_out[]; };
+layout(std430, binding = 3) writeonly buffer size_buffer { double zn_out[]; };
+layout(std430, binding = 4) writeonly buffer delta_buffer { dvec2 dn_out[]; };
+layout(std430, binding = 5) writeonly buffer scale_buffer { int scale_out[]; };
+
+uniform int count, width, height, skip, max_iter;
+uniform bool interior, bulbs;
+// the radius is radius_m * 2^radius_e, and the series coefficients times
+// radius, radius^2 and radius^3 are ua, ub and uc times 2^u_e
+uniform double radius_m;
+uniform int radius_e;
+// the offset of the center from the reference, in units of the radius
+uniform dvec2 shift;
+uniform dvec2 ua, ub, uc;
+uniform ivec3 u_e;
+
+dvec2 mul(dvec2 a, dvec2 b)
+{
+    return dvec2(a.x * b.x - a.y * b.y, a.x * b.y + a.y * b.x);
+}
+
+bool in_main_bulbs(dvec2 c)
+{
+    double x = c.x - 0.25, y2 = c.y * c.y;
+    double q = x * x + y2;
+    if (q * (q + x) <= 0.25 * y2)
+        return true;
+    return (c.x + 1) * (c.x + 1) + y2 <= 0.0625;
+}
+
+// 2^k as a double, or 0 below the double range. ldexp itself is only ever
+// given normal numbers, as some drivers get it wrong for anything else.
+double exp2i(int k)
+{
+    return k < -1022 ? 0.0lf : ldexp(1.0lf, min(k, 1023));
+}
+
+void main()
+{
+    int k = int(gl_GlobalInvocationID.x);
+    if (k >= count)
+        return;
+    int index = pixel[k];
+    int di2 = 2 * (index % width) - width, dj2 = 2 * (index / width) - height;
+    double window_radius = double(min(width, height));
+    // d0 = u * radius, where u is the offset in units of the radius
+    dvec2 u = dvec2(double(di2), -double(dj2)) / window_radius + shift;
+    dvec2 d0 = dvec2(radius_m * double(di2), -radius_m * double(dj2)) /
+               window_radius + radius_m * shift;
+
+    int iter = skip;
+    double zn_size = 0;
+    bool inside = false;
+    dvec2 dz = dvec2(1, 0);
+    int window_end = skip + interior_window, window = interior_window;
+    bool was_small = false;
+#ifndef EXTENDED
+    if (bulbs && in_main_bulbs(x[0] * 0.5 + d0))
+    {
+        iter_out[k] = max_iter;
+        zn_out[k] = -1;
+        return;
+    }
+    int scale = 0;
+    dvec2 dn = d0;
+    if (skip != 0)
+        dn = mul(mul(mul(uc, u) + ub, u) + ua, u);
+    while (true)
+    {
+        dn = mul(dn, x[iter] + dn) + d0;
+        ++iter;
+        if (iter == max_iter)
+            break;
+        dvec2 z = x[iter] * 0.5 + dn;
+#else
+    int d0_scale = radius_e;
+    int scale = d0_scale;
+    dvec2 dn = d0;
+    if (skip != 0)
+    {
+        // put the three terms on the largest exponent
+        scale = max(u_e.x, max(u_e.y, u_e.z));
+        dn = mul(ua, u) * exp2i(u_e.x - scale) +
+             mul(mul(ub, u), u) * exp2i(u_e.y - scale) +
+             mul(mul(mul(uc, u), u), u) * exp2i(u_e.z - scale);
+        if (d0_scale > scale)
+        {
+            dn *= exp2i(scale - d0_scale);
+            scale = d0_scale;
+        }
+    }
+    double dn_factor = exp2i(scale);
+    double d0_factor = exp2i(d0_scale - scale);
+    while (true)
+    {
+        dn = mul(dn, x[iter] + dn * dn_factor) + d0 * d0_factor;
+
+        // keep the mantissa within 2^+-64, but never below d0's exponent
+        double size = max(abs(dn.x), abs(dn.y));
+        // (a dn of 0 stays where it is, as frexp can't be trusted with it)
+        if (size > 1.8446744073709552e19lf ||
+            (size < 5.421010862427522e-20lf && size != 0 && scale > d0_scale))
+        {
+            int e;
+            frexp(size, e);
+            e = max(e, d0_scale - scale);
+            dn *= exp2i(-e);
+            scale += e;
+            dn_factor = exp2i(scale);
+            d0_factor = exp2i(d0_scale - scale);
+        }
+
+        ++iter;
+        if (iter == max_iter)
+            break;
+        dvec2 z = x[iter] * 0.5 + dn * dn_factor;
+#endif
+        zn_size = dot(z, z);
+
+        // use bailout radius of 256 for smooth coloring.
+        if (zn_size >= 256)
+            break;
+        if (zn_size < glitch_tolerance * 0.25 * dot(x[iter], x[iter]))
+        {
+            iter = glitched;
+            break;
+        }
+        if (interior)
+        {
+            dz = 2 * mul(dz, z);
+            if (iter >= window_end)
+            {
+                bool small = dot(dz, dz) < interior_derivative;
+                if (small && was_small)
+                {
+                    iter = max_iter;
+                    inside = true;
+                    break;
+                }
+                was_small = small;
+                dz = dvec2(1, 0);
+                window = min(window * 2, 1 << 24);
+                window_end = iter + window;
+            }
+        }
+    }
+    iter_out[k] = iter;
+    zn_out[k] = inside ? -1 : zn_size;
+    if (iter == max_iter && !inside)
+    {
+        dn_out[k] = dn;
+        scale_out[k] = scale;
+    }
+}
+)";
+
+// pixels handed to the GPU per dispatch, so that a frame can be cancelled
+// between them and no single dispatch runs long enough to upset the driver
+const int gpu_chunk = 1 << 16;
+
+// Whether SFML has a display to open OpenGL contexts on. Off Apple and
+// Windows that is the X server in $DISPLAY, and SFML aborts the process when
+// it can't connect to it, so ask before making a context without a window.
+bool has_display()
+{
+#if defined(__APPLE__) || defined(_WIN32)
+    return true;
+#else
+    const char *display = getenv("DISPLAY");
+    return display && *display;
+#endif
+}
+
+// Runs the compute shader on an OpenGL 4.3 context of its own. Everything is
+// set up on first use, and if any of it fails (no such context, a driver
+// without compute shaders or doubles) the GPU is reported unavailable once and
+// the CPU kernels take over. The context moves to whichever thread renders,
+// one frame at a time.
+class gpu_kernel
+{
+public:
+    ~gpu_kernel()
+    {
+        if (ready && context->setActive(true))
+        {
+            delete_buffers(buffer_count, buffers);
+            delete_program(programs[0]);
+            delete_program(programs[1]);
+        }
+    }
+
+    // whether the GPU was set up, and renders the frames it is given
+    bool usable() const { return ready; }
+
+    // Compute every pixel of each progressive pass that the frame doesn't have
+    // yet, and paint it. Returns false, having done nothing, if the GPU can't
+    // be used.
+    bool render(framebuffer *set, frame &pixels,
+                const reference_orbit &orbit, const floatexp &radius,
+                const series_step &start, const vector<sf::Color> &gradient,
+                const std::atomic<bool> &cancel)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        bool extended = !(radius > extended_radius);
+        // the shader keeps exponents in an int
+        if (radius.e < INT_MIN / 4 || !setup() || !context->setActive(true))
+            return false;
+        upload(orbit);
+        int max_iter = orbit_iterations(pixels, orbit);
+        bind(extended ? programs[1] : programs[0], pixels, max_iter, radius,
+             start);
+
+        const sf::Vector2u &size = pixels.size;
+        vector<int32_t> index(gpu_chunk), iter(gpu_chunk), scale(gpu_chunk);
+        vector<double> zn_size(gpu_chunk);
+        vector<float> nu(gpu_chunk);
+        vector<std::complex<double>> dn(gpu_chunk);
+        bool keep = !pixels.deltas.exp.empty();
+        for (int step = first_step; step >= 1 && !cancel; step /= 2)
+        {
+            int n = 0;
+            auto flush = [&]
+            {
+                dispatch(n, index.data(), iter.data(), zn_size.data(),
+                         keep ? dn.data() : nullptr, scale.data());
+                finish_at_orbit_end(pixels, max_iter, iter.data(),
+                                    zn_size.data(), n);
+                smooth_iters(iter.data(), zn_size.data(), n, nu.data());
+                for (int k = 0; k != n; ++k)
+                {
+                    store_pixel(pixels, index[k], iter[k], zn_size[k], nu[k]);
+                    pixels.counts.add(iter[k], pixels.max_iter);
+                    if (keep && iter[k] == pixels.max_iter && zn_size[k] >= 0)
+                        store_delta(pixels, index[k],
+                            floatexp::normalise(dn[k].real(), scale[k]),
+                            floatexp::normalise(dn[k].imag(), scale[k]));
+                    paint_block(set, pixels, gradient, index[k] % size.x,
+                                index[k] / size.x, step);
+                }
+                n = 0;
+            };
+            for (int j = 0; j < (int) size.y && !cancel; j += step)
+            {
+                for (int i = 0; i < (int) size.x; i += step)
+                {
+                    // skip the pixels an earlier pass already did
+                    if (step != first_step && i % (2 * step) == 0 &&
+                        j % (2 * step) == 0)
+                        continue;
+                    if (!unknown(pixels, i, j))
+                    {
+                        paint_block(set, pixels, gradient, i, j, step);
+                        continue;
+                    }
+                    index[n++] = i + size.x * j;
+                    if (n == gpu_chunk)
+                        flush();
+                }
+            }
+            if (n != 0 && !cancel)
+                flush();
+        }
+        context->setActive(false);
+        return true;
+    }
+
+private:
+    enum { orbit_buffer, pixel_buffer, iter_buffer, size_buffer, delta_buffer,
+           scale_buffer, buffer_count };
+
+    // load a GL function through SFML, which knows how on every platform
+    template <typename F>
+    static bool load(F &f, const char *name)
+    {
+        f = (F) sf::Context::getFunction(name);
+        return f != nullptr;
+    }
+
+    bool setup()
+    {
+        if (tried)
+            return ready;
+        tried = true;
+        if (!has_display())
+            return fail("no display");
+        context.reset(new sf::Context(sf::ContextSettings(0, 0, 0, 4, 3),
+                                      1, 1));
+        sf::ContextSettings settings = context->getSettings();
+        if (settings.majorVersion * 10 + settings.minorVersion < 43)
+            return fail("needs OpenGL 4.3");
+        if (!(load(create_shader, "glCreateShader") &&
+              load(shader_source, "glShaderSource") &&
+              load(compile_shader, "glCompileShader") &&
+              load(get_shaderiv, "glGetShaderiv") &&
+              load(get_shader_log, "glGetShaderInfoLog") &&
+              load(delete_shader, "glDeleteShader") &&
+              load(create_program, "glCreateProgram") &&
+              load(attach_shader, "glAttachShader") &&
+              load(link_program, "glLinkProgram") &&
+              load(get_programiv, "glGetProgramiv") &&
+              load(get_program_log, "glGetProgramInfoLog") &&
+              load(delete_program, "glDeleteProgram") &&
+              load(use_program, "glUseProgram") &&
+              load(uniform_location, "glGetUniformLocation") &&
+              load(uniform1i, "glUniform1i") &&
+              load(uniform3i, "glUniform3i") &&
+              load(uniform1d, "glUniform1d") &&
+              load(uniform2d, "glUniform2d") &&
+              load(gen_buffers, "glGenBuffers") &&
+              load(delete_buffers, "glDeleteBuffers") &&
+              load(bind_buffer, "glBindBuffer") &&
+              load(bind_buffer_base, "glBindBufferBase") &&
+              load(buffer_data, "glBufferData") &&
+              load(buffer_sub_data, "glBufferSubData") &&
+              load(get_buffer_sub_data, "glGetBufferSubData") &&
+              load(dispatch_compute, "glDispatchCompute") &&
+              load(memory_barrier, "glMemoryBarrier")))
+            return fail("missing OpenGL functions");
+
+        programs[0] = compile(false);
+        programs[1] = compile(true);
+        if (!programs[0] || !programs[1])
+            return fail("the compute shader doesn't build");
+
+        gen_buffers(buffer_count, buffers);
+        size_t sizes[buffer_count] = {0, sizeof(int32_t), sizeof(int32_t),
+                                      sizeof(double), 2 * sizeof(double),
+                                      sizeof(int32_t)};
+        for (int b = pixel_buffer; b != buffer_count; ++b)
+        {
+            bind_buffer(GL_SHADER_STORAGE_BUFFER, buffers[b]);
+            buffer_data(GL_SHADER_STORAGE_BUFFER, sizes[b] * gpu_chunk,
+                        nullptr, b == pixel_buffer ? GL_STREAM_DRAW :
+                                                     GL_STREAM_READ);
+            bind_buffer_base(GL_SHADER_STORAGE_BUFFER, b, buffers[b]);
+        }
+        context->setActive(false);
+        cout << "GPU kernel: OpenGL " << settings.majorVersion << "."
+             << settings.minorVersion << endl;
+        return ready = true;
+    }
+
+    bool fail(const char *reason)
+    {
+        std::cerr << "antelbrot: no GPU kernel, " << reason << endl;
+        if (context)
+            context->setActive(false);
+        return false;
+    }
+
+    // build the shader on the constants the CPU kernels use
+    GLuint compile(bool extended)
+    {
+        std::ostringstream prefix;
+        prefix.precision(17);
+        prefix << "#version 430\n";
+        if (extended)
+            prefix << "#define EXTENDED\n";
+        prefix << "const int glitched = " << glitched << ";\n"
+               << "const double glitch_tolerance = " << glitch_tolerance
+               << "lf;\n"
+               << "const double interior_derivative = " << interior_derivative
+               << "lf;\n"
+               << "const int interior_window = " << interior_window << ";\n";
+        std::string text = prefix.str() + gpu_kernel_source;
+        const GLchar *source = text.c_str();
+
+        GLuint shader = create_shader(GL_COMPUTE_SHADER);
+        shader_source(shader, 1, &source, nullptr);
+        compile_shader(shader);
+        GLint ok = 0;
+        get_shaderiv(shader, GL_COMPILE_STATUS, &ok);
+        GLuint program = 0;
+        if (ok)
+        {
+            program = create_program();
+            attach_shader(program, shader);
+            link_program(program);
+            get_programiv(program, GL_LINK_STATUS, &ok);
+        }
+        if (!ok)
+        {
+            char log[4096] = "";
+            if (program)
+                get_program_log(program, sizeof log, nullptr, log);
+            else
+                get_shader_log(shader, sizeof log, nullptr, log);
+            std::cerr << log << endl;
+            if (program)
+                delete_program(program);
+            program = 0;
+        }
+        delete_shader(shader);
+        return program;
+    }
+
+    // send the orbit to the GPU, unless it is there already (the orbit
+    // points are never written, so the same storage means the same points)
+    void upload(const reference_orbit &orbit)
+    {
+        if (uploaded.data() == orbit.x.data() &&
+            uploaded.size() >= orbit.x.size())
+            return;
+        uploaded = orbit.x;
+        bind_buffer(GL_SHADER_STORAGE_BUFFER, buffers[orbit_buffer]);
+        buffer_data(GL_SHADER_STORAGE_BUFFER,
+                    uploaded.size() * sizeof(std::complex<double>),
+                    uploaded.data(), GL_STATIC_DRAW);
+        bind_buffer_base(GL_SHADER_STORAGE_BUFFER, orbit_buffer,
+                         buffers[orbit_buffer]);
+    }
+
+    // set the uniforms of the frame, which the shader iterates up to max_iter
+    void bind(GLuint program, const frame &pixels, int max_iter,
+              const floatexp &radius, const series_step &start)
+    {
+        use_program(program);
+        auto at = [&](const char *name)
+        {
+            return uniform_location(program, name);
+        };
+        uniform1i(at("width"), pixels.size.x);
+        uniform1i(at("height"), pixels.size.y);
+        uniform1i(at("skip"), start.skip);
+        uniform1i(at("max_iter"), max_iter);
+        uniform1i(at("interior"), pixels.interior_checks);
+        uniform1i(at("bulbs"), pixels.interior_checks &&
+                               (double) radius > bulb_test_radius);
+
+        // with extended range every factor keeps its own exponent
+        bool extended = !(radius > extended_radius);
+        uniform1d(at("radius_m"), extended ? radius.m : radius.get_d());
+        uniform1i(at("radius_e"), extended ? radius.e : 0);
+        uniform2d(at("shift"), pixels.shift.real(), pixels.shift.imag());
+        complexfe r(radius);
+        complexfe u[3] = {start.a * r, start.b * r * r, start.c * r * r * r};
+        std::complex<double> u_d[3] = {start.ua, start.ub, start.uc};
+        int u_e[3] = {0, 0, 0};
+        for (int k = 0; k != 3 && extended; ++k)
+        {
+            // split into a complex<double> and an exponent, like
+            // kernel_scalar<floatexp> does
+            int64_t e = std::max(u[k].re.e, u[k].im.e);
+            e = std::max<int64_t>(e, INT_MIN / 4);
+            u_d[k] = std::complex<double>(std::ldexp(u[k].re.m, u[k].re.e - e),
+                                          std::ldexp(u[k].im.m, u[k].im.e - e));
+            u_e[k] = e;
+        }
+        uniform2d(at("ua"), u_d[0].real(), u_d[0].imag());
+        uniform2d(at("ub"), u_d[1].real(), u_d[1].imag());
+        uniform2d(at("uc"), u_d[2].real(), u_d[2].imag());
+        uniform3i(at("u_e"), u_e[0], u_e[1], u_e[2]);
+        count_location = at("count");
+    }
+
+    // run the shader on n pixels and read back what it wrote
+    void dispatch(int n, const int32_t *index, int32_t *iter, double *zn_size,
+                  std::complex<double> *dn, int32_t *scale)
+    {
+        bind_buffer(GL_SHADER_STORAGE_BUFFER, buffers[pixel_buffer]);
+        buffer_sub_data(GL_SHADER_STORAGE_BUFFER, 0, n * sizeof(int32_t),
+                        index);
+        uniform1i(count_location, n);
+        dispatch_compute((n + 63) / 64, 1, 1);
+        memory_barrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+        auto read = [&](int b, size_t bytes, void *to)
+        {
+            bind_buffer(GL_SHADER_STORAGE_BUFFER, buffers[b]);
+            get_buffer_sub_data(GL_SHADER_STORAGE_BUFFER, 0, n * bytes, to);
+        };
+        read(iter_buffer, sizeof(int32_t), iter);
+        read(size_buffer, sizeof(double), zn_size);
+        if (dn)
+        {
+            read(delta_buffer, 2 * sizeof(double), dn);
+            read(scale_buffer, sizeof(int32_t), scale);
+        }
+    }
+
+    std::mutex lock;
+    std::unique_ptr<sf::Context> context;
+    bool tried = false, ready = false;
+    GLuint programs[2] = {0, 0};
+    GLuint buffers[buffer_count];
+    GLint count_location = -1;
+    orbit_points uploaded;
+
+    PFNGLCREATESHADERPROC create_shader;
+    PFNGLSHADERSOURCEPROC shader_source;
+    PFNGLCOMPILESHADERPROC compile_shader;
+    PFNGLGETSHADERIVPROC get_shaderiv;
+    PFNGLGETSHADERINFOLOGPROC get_shader_log;
+    PFNGLDELETESHADERPROC delete_shader;
+    PFNGLCREATEPROGRAMPROC create_program;
+    PFNGLATTACHSHADERPROC attach_shader;
+    PFNGLLINKPROGRAMPROC link_program;
+    PFNGLGETPROGRAMIVPROC get_programiv;
+    PFNGLGETPROGRAMINFOLOGPROC get_program_log;
+    PFNGLDELETEPROGRAMPROC delete_program;
+    PFNGLUSEPROGRAMPROC use_program;
+    PFNGLGETUNIFORMLOCATIONPROC uniform_location;
+    PFNGLUNIFORM1IPROC uniform1i;
+    PFNGLUNIFORM3IPROC uniform3i;
+    PFNGLUNIFORM1DPROC uniform1d;
+    PFNGLUNIFORM2DPROC uniform2d;
+    PFNGLGENBUFFERSPROC gen_buffers;
+    PFNGLDELETEBUFFERSPROC delete_buffers;
+    PFNGLBINDBUFFERPROC bind_buffer;
+    PFNGLBINDBUFFERBASEPROC bind_buffer_base;
+    PFNGLBUFFERDATAPROC buffer_data;
+    PFNGLBUFFERSUBDATAPROC buffer_sub_data;
+    PFNGLGETBUFFERSUBDATAPROC get_buffer_sub_data;
+    PFNGLDISPATCHCOMPUTEPROC dispatch_compute;
+    PFNGLMEMORYBARRIERPROC memory_barrier;
+};
+
+// Fixing glitches
+
+// what a frame shows
+struct view
+{
+    mpf_class center_r, center_i;
+    floatexp radius;
+    int depth;
+};
+
+// the most secondary references a frame gets before its remaining glitches
+// are filled in from their neighbours
+const int max_references = 16;
+
+// the connected groups of glitched pixels, largest first
+vector<vector<int>> glitch_groups(const frame &pixels)
+{
+    int w = pixels.size.x, h = pixels.size.y;
+    vector<char> seen(w * h, 0);
+    vector<vector<int>> groups;
+    for (int start = 0; start != w * h; ++start)
+    {
+        if (seen[start] || pixels.iter[start] != glitched)
+            continue;
+        vector<int> group(1, start);
+        seen[start] = 1;
+        for (size_t k = 0; k != group.size(); ++k)
+        {
+            int i = group[k] % w, j = group[k] / w;
+            int next[4][2] = {{i - 1, j}, {i + 1, j}, {i, j - 1}, {i, j + 1}};
+            for (auto &n : next)
+            {
+                if (n[0] < 0 || n[0] >= w || n[1] < 0 || n[1] >= h)
+                    continue;
+                int index = n[0] + w * n[1];
+                if (!seen[index] && pixels.iter[index] == glitched)
+                {
+                    seen[index] = 1;
+                    group.push_back(index);
+                }
+            }
+        }
+        groups.push_back(std::move(group));
+    }
+    std::sort(groups.begin(), groups.end(),
+              [](const vector<int> &a, const vector<int> &b)
+              { return a.size() > b.size(); });
+    return groups;
+}
+
+// Redo the pixels of a group against the orbit of the reference pixel
+// (ref_i, ref_j). A pixel that runs past the end of a shorter orbit has not
+// been decided, so it stays glitched.
+template <typename R>
+void render_group(framebuffer *set, frame &pixels,
+                  const vector<int> &group, const reference_orbit &orbit,
+                  const series_step &start, const R &radius, int ref_i,
+                  int ref_j, const vector<sf::Color> &gradient,
+                  thread_pool &pool, const std::atomic<bool> &cancel)
+{
+    const sf::Vector2u &size = pixels.size;
+    int max_iter = orbit_iterations(pixels, orbit);
+    vector<pixel_counts> counts((group.size() + tile_size - 1) / tile_size);
+    task_group chunks;
+    for (size_t first = 0; first < group.size(); first += tile_size)
+    {
+        pool.submit(chunks, [=, &pixels, &group, &orbit, &start, &radius,
+                             &gradient, &cancel, &counts]
+        {
+            if (cancel)
+                return;
+            R d0_r[tile_size], d0_i[tile_size];
+            double zn_size[tile_size];
+            int iter[tile_size];
+            int n = std::min((size_t) tile_size, group.size() - first);
+            for (int k = 0; k != n; ++k)
+            {
+                int i = group[first + k] % size.x;
+                int j = group[first + k] / size.x;
+                complex_t<R> d0 = pixel_offset(2 * (i - ref_i),
+                                               2 * (j - ref_j), size, radius);
+                d0_r[k] = d0.re;
+                d0_i[k] = d0.im;
+            }
+            run_kernel(d0_r, d0_i, n, orbit.x.data(), max_iter, start, iter,
+                       zn_size, pixels.interior_checks, pixels.single);
+            finish_at_orbit_end(pixels, max_iter, iter, zn_size, n);
+            for (int k = 0; k != n; ++k)
+            {
+                int index = group[first + k];
+                store_pixel(pixels, index, iter[k], zn_size[k]);
+                counts[first / tile_size].add(iter[k], pixels.max_iter);
+                paint_block(set, pixels, gradient, index % size.x,
+                            index / size.x, 1);
+            }
+        });
+    }
+    pool.wait(chunks);
+    for (const pixel_counts &c : counts)
+        pixels.counts.add(c);
+}
+
+// Compute a secondary reference orbit at the pixel of the group that came
+// closest to the old reference, or failing that the one closest to the middle
+// of the group, and redo the group against it.
+void fix_group(framebuffer *set, frame &pixels, const vector<int> &group,
+               const view &v, const vector<sf::Color> &gradient,
+               thread_pool &pool, const std::atomic<bool> &cancel)
+{
+    const sf::Vector2u &size = pixels.size;
+    int w = size.x;
+    double mid_i = 0, mid_j = 0;
+    int min_i = w, min_j = size.y, max_i = 0, max_j = 0;
+    for (int index : group)
+    {
+        int i = index % w, j = index / w;
+        mid_i += i;
+        mid_j += j;
+        min_i = std::min(min_i, i);
+        min_j = std::min(min_j, j);
+        max_i = std::max(max_i, i);
+        max_j = std::max(max_j, j);
+    }
+    mid_i /= group.size();
+    mid_j /= group.size();
+    int ref = group[0];
+    double best = INFINITY, best_size = INFINITY;
+    for (int index : group)
+    {
+        double di = index % w - mid_i, dj = index / w - mid_j;
+        double size = pixels.nu[index];
+        if (size < best_size ||
+            (size == best_size && di * di + dj * dj < best))
+        {
+            best = di * di + dj * dj;
+            best_size = size;
+            ref = index;
+        }
+    }
+    int ref_i = ref % w, ref_j = ref / w;
+
+    mp_bitcnt_t bits = precision_bits(v.radius);
+    complexfe offset = pixel_delta(ref_i, ref_j, size, v.radius);
+    mpf_class center_r(v.center_r, bits), center_i(v.center_i, bits);
+    center_r += offset.re.get_mpf(bits);
+    center_i += offset.im.get_mpf(bits);
+    reference_orbit orbit = deep_zoom_point(center_r, center_i,
+                                            pixels.max_iter, bits, &cancel);
+    if (cancel)
+        return;
+
+    // check the series on the corners of the group's bounding box
+    vector<complexfe> probes;
+    for (int i : {min_i, max_i})
+        for (int j : {min_j, max_j})
+            probes.push_back(pixel_offset(2 * (i - ref_i), 2 * (j - ref_j),
+                                          size, v.radius));
+    series_step start = series_skip(orbit, probes, v.radius);
+    if (v.radius > extended_radius)
+        render_group<double>(set, pixels, group, orbit, start,
+                             v.radius.get_d(), ref_i, ref_j, gradient, pool,
+                             cancel);
+    else
+        render_group<floatexp>(set, pixels, group, orbit, start, v.radius,
+                               ref_i, ref_j, gradient, pool, cancel);
+}
+
+// Give every glitch that is left the result of a neighbour that isn't one,
+// and mark it filled.
+void fill_glitches(framebuffer *set, frame &pixels,
+                   const vector<sf::Color> &gradient)
+{
+    int w = pixels.size.x, h = pixels.size.y;
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (int j = 0; j != h; ++j)
+        {
+            for (int i = 0; i != w; ++i)
+            {
+                int index = i + w * j;
+                if (pixels.iter[index] != glitched)
+                    continue;
+                int next[4][2] = {{i - 1, j}, {i + 1, j}, {i, j - 1},
+                                  {i, j + 1}};
+                for (auto &n : next)
+                {
+                    if (n[0] < 0 || n[0] >= w || n[1] < 0 || n[1] >= h)
+                        continue;
+                    int from = n[0] + w * n[1];
+                    if (pixels.iter[from] >= 0)
+                    {
+                        if (pixels.filled.empty())
+                            pixels.filled.assign(pixels.iter.size(), 0);
+                        pixels.filled[index] = 1;
+                        ++pixels.stats.filled;
+                        pixels.iter[index] = pixels.iter[from];
+                        pixels.nu[index] = pixels.nu[from];
+                        pixels.counts.add(pixels.iter[index],
+                                          pixels.max_iter);
+                        paint_block(set, pixels, gradient, i, j, 1);
+                        changed = true;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Fix the glitches in rounds, the largest groups first, until none are left
+// or the frame runs out of references.
+void fix_glitches(framebuffer *set, frame &pixels, const view &v,
+                  const vector<sf::Color> &gradient, thread_pool &pool,
+                  const std::atomic<bool> &cancel)
+{
+    int references = 0;
+    while (references < max_references && !cancel)
+    {
+        vector<vector<int>> groups = glitch_groups(pixels);
+        if (groups.empty())
+            return;
+        if (references == 0)
+            for (const vector<int> &group : groups)
+                pixels.stats.glitches += group.size();
+        for (const vector<int> &group : groups)
+        {
+            if (references == max_references || cancel)
+                break;
+            fix_group(set, pixels, group, v, gradient, pool, cancel);
+            ++references;
+            ++pixels.stats.references;
+        }
+    }
+    if (!cancel)
+        fill_glitches(set, pixels, gradient);
+}
+
+// Anti-aliasing
+
+// A pixel gets more samples where its smooth iteration count differs from a
+// neighbour's by more than this, or where one of them is inside and the
+// other isn't. Elsewhere the colors change too slowly across a pixel to
+// alias.
+const float aa_threshold = 1;
+
+// the pixels on the edges of the frame's picture, that need more samples
+vector<int> aa_edges(const frame &pixels)
+{
+    int w = pixels.size.x, h = pixels.size.y;
+    vector<char> edge(pixels.iter.size(), 0);
+    auto differ = [&](int a, int b)
+    {
+        int iter_a = pixels.iter[a], iter_b = pixels.iter[b];
+        if (iter_a < 0 || iter_b < 0)
+            return false;
+        bool inside_a = iter_a == pixels.max_iter;
+        bool inside_b = iter_b == pixels.max_iter;
+        if (inside_a || inside_b)
+            return inside_a != inside_b;
+        return std::fabs(pixels.nu[a] - pixels.nu[b]) > aa_threshold;
+    };
+    for (int j = 0; j != h; ++j)
+    {
+        for (int i = 0; i != w; ++i)
+        {
+            int index = i + w * j;
+            if (i + 1 != w && differ(index, index + 1))
+                edge[index] = edge[index + 1] = 1;
+            if (j + 1 != h && differ(index, index + w))
+                edge[index] = edge[index + w] = 1;
+        }
+    }
+    vector<int> edges;
+    for (int index = 0; index != (int) edge.size(); ++index)
+        if (edge[index])
+            edges.push_back(index);
+    return edges;
+}
+
+// a number in [0, 1) that looks random, from an integer
+inline double aa_jitter(uint32_t h)
+{
+    h ^= h >> 16;
+    h *= 0x7feb352d;
+    h ^= h >> 15;
+    h *= 0x846ca68b;
+    h ^= h >> 16;
+    return h / 4294967296.0;
+}
+
+// the average color of the samples of pixel aa_pixels[e]. Samples that
+// glitched count with the color of their pixel.
+sf::Color aa_average(const frame &pixels, const vector<sf::Color> &gradient,
+                     size_t e)
+{
+    int index = pixels.aa_pixels[e];
+    size_t samples = pixels.aa_grid * pixels.aa_grid;
+    sf::Color own = pixel_color(gradient, pixels.iter[index], pixels.nu[index],
+                                pixels.max_iter);
+    int r = 0, g = 0, b = 0;
+    for (size_t k = e * samples; k != (e + 1) * samples; ++k)
+    {
+        sf::Color color = pixels.aa_iter[k] < 0 ? own :
+            pixel_color(gradient, pixels.aa_iter[k], pixels.aa_nu[k],
+                        pixels.max_iter);
+        r += color.r;
+        g += color.g;
+        b += color.b;
+    }
+    return sf::Color(r / samples, g / samples, b / samples);
+}
+
+// Sample every edge pixel again on an aa_grid x aa_grid grid of cells, at a
+// jittered point in each, against the frame's own reference and series, and
+// keep the samples and their average color. The jitter is the same every
+// time, so frames come out the same.
+template <typename R>
+void antialias(framebuffer *set, frame &pixels, const reference_orbit &orbit,
+               const R &radius, const series_step &start,
+               const bla_table<R> *bla, const vector<sf::Color> &gradient,
+               thread_pool &pool, const std::atomic<bool> &cancel)
+{
+    pixels.aa_pixels = aa_edges(pixels);
+    const vector<int> &edges = pixels.aa_pixels;
+    pixels.aa.assign(pixels.iter.size(), sf::Color::Transparent);
+    const sf::Vector2u &size = pixels.size;
+    int grid = pixels.aa_grid, samples = grid * grid;
+    pixels.aa_iter.assign(edges.size() * samples, 0);
+    pixels.aa_nu.assign(edges.size() * samples, 0);
+    R step = radius / R((size.x < size.y) ? size.x : size.y);
+    R shift_r = radius * R(pixels.shift.real());
+    R shift_i = radius * R(pixels.shift.imag());
+    task_group chunks;
+    for (size_t first = 0; first < edges.size(); first += tile_size)
+    {
+        pool.submit(chunks, [=, &pixels, &edges, &orbit, &start, &gradient,
+                             &cancel]
+        {
+            if (cancel)
+                return;
+            size_t end = std::min(first + tile_size, edges.size());
+            int n = (end - first) * samples;
+            vector<R> d0_r(n), d0_i(n);
+            vector<int> iter(n);
+            vector<double> zn_size(n);
+            for (int k = 0; k != n; ++k)
+            {
+                int index = edges[first + k / samples], cell = k % samples;
+                int i = index % size.x, j = index / size.x;
+                uint32_t seed = 2 * ((uint32_t) index * samples + cell);
+                double x2 = 2 * i - (int) size.x - 1 + 2 *
+                            (cell % grid + aa_jitter(seed)) / grid;
+                double y2 = 2 * j - (int) size.y - 1 + 2 *
+                            (cell / grid + aa_jitter(seed + 1)) / grid;
+                d0_r[k] = step * R(x2) + shift_r;
+                d0_i[k] = -step * R(y2) + shift_i;
+            }
+            int max_iter = orbit_iterations(pixels, orbit);
+            run_kernel(d0_r.data(), d0_i.data(), n, orbit.x.data(), max_iter,
+                       start, iter.data(), zn_size.data(),
+                       pixels.interior_checks, pixels.single,
+                       kernel_deltas<R>(), bla);
+            finish_at_orbit_end(pixels, max_iter, iter.data(), zn_size.data(),
+                                n);
+            size_t base = first * samples;
+            for (int k = 0; k != n; ++k)
+            {
+                pixels.aa_iter[base + k] = iter[k];
+                pixels.aa_nu[base + k] = iter[k] >= 0 ?
+                    smooth_iter(zn_size[k], iter[k]) : 0;
+            }
+            for (size_t e = first; e != end; ++e)
+            {
+                int index = edges[e];
+                sf::Color color = aa_average(pixels, gradient, e);
+                pixels.aa[index] = color;
+                if (set)
+                    set->paint(index % size.x, index / size.x,
+                               index % size.x + 1, index / size.x + 1, color);
+            }
+        });
+    }
+    pool.wait(chunks);
+}
+
+// the color of pixel index in a finished frame, the averaged one if it got
+// more samples
+sf::Color frame_color(const frame &pixels, const vector<sf::Color> &gradient,
+                      int index)
+{
+    if (!pixels.aa.empty() && pixels.aa[index].a != 0)
+        return pixels.aa[index];
+    return pixel_color(gradient, pixels.iter[index], pixels.nu[index],
+                       pixels.max_iter);
+}
+
+// BLA takes over from the SIMD kernels, or the extended range one, where a
+// sample of the frame's pixels goes through at least this many iterations
+// per step, which makes up for leaving the lanes behind. Frames that iterate
+// less than bla_min_iterations past the series don't try it.
+const double bla_min_gain = 8;
+const int bla_min_iterations = 1000;
+
+// The BLA table of a frame, or null if an 8 x 8 grid of its pixels doesn't
+// jump far enough with it. The gain goes into the stats, 0 without a table.
+template <typename R>
+std::unique_ptr<bla_table<R>> frame_bla(frame &pixels,
+                                        const reference_orbit &orbit,
+                                        const R &radius,
+                                        const series_step &start)
+{
+    pixels.stats.bla_gain = 0;
+    std::unique_ptr<bla_table<R>> table;
+    int max_iter = orbit_iterations(pixels, orbit);
+    if (max_iter - start.skip < bla_min_iterations || pixels.single)
+        return table;
+
+    // the pixels are all within the corners, which are at most this far
+    // from the reference
+    const sf::Vector2u &size = pixels.size;
+    double window_radius = std::min(size.x, size.y);
+    R max_d0 = radius * R(std::abs(pixels.shift) +
+                          std::hypot((double) size.x, (double) size.y) /
+                          window_radius);
+    table.reset(new bla_table<R>(bla_steps(orbit.x, max_d0)));
+
+    const int grid = 8, n = grid * grid;
+    R d0_r[n], d0_i[n];
+    int iter[n];
+    double zn_size[n];
+    for (int k = 0; k != n; ++k)
+    {
+        int i = (2 * (k % grid) + 1) * size.x / (2 * grid);
+        int j = (2 * (k / grid) + 1) * size.y / (2 * grid);
+        complex_t<R> d0 = pixel_delta(i, j, size, radius, pixels.shift);
+        d0_r[k] = d0.re;
+        d0_i[k] = d0.im;
+    }
+    bla_counts counts;
+    kernel_bla<R>(d0_r, d0_i, n, orbit.x.data(), max_iter, start, iter,
+                  zn_size, pixels.interior_checks, kernel_deltas<R>(), *table,
+                  &counts);
+    double gain = (double) counts.iterations / std::max(counts.steps, 1L);
+    if (gain < bla_min_gain)
+        table.reset();
+    else
+        pixels.stats.bla_gain = gain;
+    return table;
+}
+
+// render a frame, on double unless the radius needs extended range, and fix
+// its glitches (unless it keeps them). With a GPU kernel that works, the GPU
+// computes the pixels the frame doesn't have yet, and the rest stays on the
+// CPU. With aa_grid set, the edges get their extra samples last.
+void update(framebuffer *set, frame &pixels,
+            const reference_orbit &orbit, const view &v,
+            const vector<sf::Color> &gradient, thread_pool &pool,
+            const std::atomic<bool> &cancel, gpu_kernel *gpu = nullptr)
+{
+    const floatexp &radius = v.radius;
+    auto begin = std::chrono::steady_clock::now();
+    auto seconds = [&]
+    {
+        auto now = std::chrono::steady_clock::now();
+        double since = std::chrono::duration<double>(now - begin).count();
+        begin = now;
+        return since;
+    };
+    series_step start = series_skip(
+        orbit, frame_probes(pixels.size, radius, pixels.shift), radius);
+    // the series may skip further than the resumable pixels have got
+    if (pixels.resume_from != 0 && start.skip >= pixels.resume_from)
+        std::replace(pixels.iter.begin(), pixels.iter.end(), resumable, -1);
+    pixels.stats.skip = start.skip;
+    pixels.single = single_enough(orbit, radius, pixels.size, start,
+                                  pixels.max_iter);
+    bool done = gpu && gpu->render(set, pixels, orbit, radius, start, gradient,
+                                   cancel);
+    std::unique_ptr<bla_table<double>> bla;
+    std::unique_ptr<bla_table<floatexp>> bla_fe;
+    if (radius > extended_radius)
+    {
+        bla = frame_bla<double>(pixels, orbit, radius.get_d(), start);
+        if (!done)
+            render<double>(set, pixels, orbit, radius.get_d(), start,
+                           bla.get(), gradient, pool, cancel);
+        resume<double>(set, pixels, orbit, radius.get_d(), bla.get(),
+                       gradient, pool, cancel);
+    }
+    else
+    {
+        bla_fe = frame_bla<floatexp>(pixels, orbit, radius, start);
+        if (!done)
+            render<floatexp>(set, pixels, orbit, radius, start, bla_fe.get(),
+                             gradient, pool, cancel);
+        resume<floatexp>(set, pixels, orbit, radius, bla_fe.get(), gradient,
+                         pool, cancel);
+    }
+    pixels.stats.pixel_seconds = seconds();
+    if (!pixels.keep_glitches)
+        fix_glitches(set, pixels, v, gradient, pool, cancel);
+    pixels.stats.glitch_seconds = seconds();
+    if (pixels.aa_grid > 1 && !cancel)
+    {
+        if (radius > extended_radius)
+            antialias<double>(set, pixels, orbit, radius.get_d(), start,
+                              bla.get(), gradient, pool, cancel);
+        else
+            antialias<floatexp>(set, pixels, orbit, radius, start,
+                                bla_fe.get(), gradient, pool, cancel);
+    }
+}
+
+// Fill in the pixel stats of a finished frame from the counts its tasks kept.
+void count_pixels(frame &pixels)
+{
+    const pixel_counts &counts = pixels.counts;
+    frame_stats &stats = pixels.stats;
+    stats.mean_iter = counts.escaped ? counts.iterations / counts.escaped : 0;
+    stats.max_iter = counts.max_iter;
+    stats.inside = pixels.iter.empty() ? 0 :
+                   (double) counts.inside / pixels.iter.size();
+}
+
+// the stats of a frame on one line, or on one line each with a separator of
+// "\n"
+std::string describe(const frame_stats &stats, const char *separator = ", ")
+{
+    std::ostringstream out;
+    out.precision(3);
+    out << "orbit: " << stats.orbit_seconds << " s" << separator;
+    if (stats.period != 0)
+        out << "reference: period " << stats.period << " nucleus" << separator;
+    out << "skip: " << stats.skip << separator;
+    if (stats.bla_gain != 0)
+        out << "bla: " << stats.bla_gain << " iterations per step" << separator;
+    out << "iterations: " << stats.mean_iter << " mean, " << stats.max_iter
+        << " max" << separator
+        << "at max_iter: " << 100 * stats.inside << "%" << separator
+        << "glitches: " << stats.glitches << " (" << stats.references
+        << " references, " << stats.filled << " filled)" << separator
+        << "frame: " << stats.frame_seconds << " s (pixels: "
+        << stats.pixel_seconds << " s, glitches: " << stats.glitch_seconds
+        << " s)";
+    return out.str();
+}
+
+// Paint the whole frame again from the results it keeps, for a new gradient.
+// No pixel is iterated again, only looked up in the gradient, a band of rows
+// per task, and the anti-aliased pixels averaged again from their samples.
+// Pixels the frame doesn't know yet come out black.
+void recolor(framebuffer *set, const frame &pixels,
+             const vector<sf::Color> &gradient, thread_pool &pool)
+{
+    const sf::Vector2u &size = pixels.size;
+    if (size.x != set->get_size().x || size.y != set->get_size().y)
+        return;
+    task_group rows;
+    for (int first = 0; first < (int) size.y; first += tile_size)
+    {
+        pool.submit(rows, [=, &pixels, &gradient]
+        {
+            int end = std::min(first + tile_size, (int) size.y);
+            for (int j = first; j != end; ++j)
+            {
+                int row = size.x * j;
+                set->paint_row(j, [&](int i)
+                {
+                    return pixel_color(gradient, pixels.iter[row + i],
+                                       pixels.nu[row + i], pixels.max_iter);
+                });
+            }
+        });
+    }
+    pool.wait(rows);
+
+    task_group chunks;
+    for (size_t first = 0; first < pixels.aa_pixels.size();
+         first += tile_size)
+    {
+        pool.submit(chunks, [=, &pixels, &gradient]
+        {
+            size_t end = std::min(first + tile_size, pixels.aa_pixels.size());
+            for (size_t e = first; e != end; ++e)
+            {
+                // (unless the frame was stopped before it got to them)
+                int index = pixels.aa_pixels[e];
+                if (pixels.aa[index].a == 0)
+                    continue;
+                int i = index % size.x, j = index / size.x;
+                set->paint(i, j, i + 1, j + 1,
+                           aa_average(pixels, gradient, e));
+            }
+        });
+    }
+    pool.wait(chunks);
+}
+
+// Rendering in the background
+
+// Copy the result of pixel from of the old frame to pixel to of the next one,
+// if it still holds at the depth of the next frame and isn't only a filled
+// in one. Returns whether it did.
+bool copy_pixel(const frame &old, int from, frame &next, int to)
+{
+    int iter = old.iter[from];
+    if (iter < 0 || was_filled(old, from))
+        return false;
+    // a pixel that never escaped is only known to stay inside up to the old
+    // max_iter, unless an interior check found it
+    if (iter == old.max_iter && old.max_iter < next.max_iter &&
+        old.nu[from] != known_inside)
+        return false;
+    next.iter[to] = (iter == old.max_iter) ? next.max_iter :
+                    std::min(iter, next.max_iter);
+    next.nu[to] = old.nu[from];
+    next.counts.add(next.iter[to], next.max_iter);
+    return true;
+}
+
+// When v is old_view zoomed in 2x with its center on one of the old pixels,
+// every other pixel in each direction of the new frame is exactly an old
+// pixel. Copy those results over instead of computing them again, and return
+// how many pixels were copied.
+int reuse_zoom(const frame &old, const view &old_view, frame &next,
+               const view &v)
+{
+    floatexp half = old_view.radius / 2;
+    if (old.size.x != next.size.x || old.size.y != next.size.y ||
+        half.m != v.radius.m || half.e != v.radius.e)
+        return 0;
+
+    // find the old pixel (m_i, m_j) the new center sits on, from
+    // offset = radius * (2 m - size) / window_radius
+    int w = old.size.x, h = old.size.y;
+    int window_radius = std::min(w, h);
+    mpf_class offset_r = v.center_r - old_view.center_r;
+    mpf_class offset_i = v.center_i - old_view.center_i;
+    double q_r = (floatexp::from_mpf(offset_r) / old_view.radius *
+                  window_radius).get_d();
+    double q_i = -(floatexp::from_mpf(offset_i) / old_view.radius *
+                   window_radius).get_d();
+    double round_r = std::round(q_r), round_i = std::round(q_i);
+    if (std::fabs(q_r - round_r) > 1e-6 || std::fabs(q_i - round_i) > 1e-6)
+        return 0;
+    int m_i = (int) round_r + w, m_j = (int) round_i + h;
+    if (m_i % 2 != 0 || m_j % 2 != 0)
+        return 0;
+    m_i /= 2;
+    m_j /= 2;
+
+    // new pixel i lands on old pixel m_i + (2 i - w) / 4
+    int copied = 0;
+    for (int j = 0; j != h; ++j)
+    {
+        if ((2 * j - h) % 4 != 0)
+            continue;
+        int old_j = m_j + (2 * j - h) / 4;
+        if (old_j < 0 || old_j >= h)
+            continue;
+        for (int i = 0; i != w; ++i)
+        {
+            if ((2 * i - w) % 4 != 0)
+                continue;
+            int old_i = m_i + (2 * i - w) / 4;
+            if (old_i < 0 || old_i >= w)
+                continue;
+
+            copied += copy_pixel(old, old_i + w * old_j, next, i + w * j);
+        }
+    }
+    return copied;
+}
+
+// When v only changes the depth of old_view, every pixel that escaped keeps
+// its result. Copy those over, and return how many there were. With more
+// depth, the pixels that have their final delta go on from it, if the next
+// frame keeps deltas too.
+int reuse_depth(const frame &old, const view &old_view, frame &next,
+                const view &v)
+{
+    if (old.size.x != next.size.x || old.size.y != next.size.y ||
+        old_view.radius.m != v.radius.m || old_view.radius.e != v.radius.e ||
+        cmp(old_view.center_r, v.center_r) != 0 ||
+        cmp(old_view.center_i, v.center_i) != 0)
+        return 0;
+    bool resume = old.max_iter < next.max_iter && !old.deltas.exp.empty() &&
+                  !next.deltas.exp.empty() && old.shift == next.shift;
+    if (resume)
+        next.resume_from = old.max_iter;
+    int copied = 0;
+    for (int index = 0; index != (int) old.iter.size(); ++index)
+    {
+        if (copy_pixel(old, index, next, index))
+            ++copied;
+        else if (resume && old.iter[index] == old.max_iter &&
+                 old.deltas.exp[index] != no_delta && !was_filled(old, index))
+        {
+            next.iter[index] = resumable;
+            next.deltas.re[index] = old.deltas.re[index];
+            next.deltas.im[index] = old.deltas.im[index];
+            next.deltas.exp[index] = old.deltas.exp[index];
+        }
+    }
+    return copied;
+}
+
+// Automatic depth probes a frame at 1/probe_scale of its size. Its depth goes
+// up 4x while more than one in late_escapes of the probe pixels escape in the
+// upper half of the depth, between min_auto_depth and max_auto_depth.
+const unsigned probe_scale = 8;
+const int late_escapes = 1000;
+const int min_auto_depth = 1000;
+const int max_auto_depth = 1 << 26;
+
+// Whether a probe render shows that its depth is too low: too many of its
+// pixels escape in the upper half of the depth, or stop at max_iter next to
+// one that escaped without an interior check finding them inside, or none
+// escape and not all are known inside. Sets highest to the last escape.
+bool needs_depth(const frame &probe, int *highest)
+{
+    int w = probe.size.x, h = probe.size.y;
+    int late = 0, escaped = 0, unknown = 0;
+    *highest = 0;
+    auto escapes = [&](int i, int j)
+    {
+        if (i < 0 || i >= w || j < 0 || j >= h)
+            return false;
+        int iter = probe.iter[i + w * j];
+        return iter >= 0 && iter != probe.max_iter;
+    };
+    for (int j = 0; j != h; ++j)
+    {
+        for (int i = 0; i != w; ++i)
+        {
+            int index = i + w * j, iter = probe.iter[index];
+            if (iter == probe.max_iter)
+            {
+                if (probe.nu[index] == known_inside)
+                    continue;
+                ++unknown;
+                if (escapes(i - 1, j) || escapes(i + 1, j) ||
+                    escapes(i, j - 1) || escapes(i, j + 1))
+                    ++late;
+            }
+            else if (iter >= 0)
+            {
+                ++escaped;
+                *highest = std::max(*highest, iter);
+                late += iter > probe.max_iter / 2;
+            }
+        }
+    }
+    return late * late_escapes > w * h || (escaped == 0 && unknown != 0);
+}
+
+// The nucleus of the lowest period within reach of the corners of a frame of
+// this size and view, up to its depth, as find_nucleus gives it.
+int frame_nucleus(const sf::Vector2u &size, const view &v,
+                  mpf_class &nucleus_r, mpf_class &nucleus_i,
+                  const std::atomic<bool> *cancel = nullptr)
+{
+    double window_radius = std::min(size.x, size.y);
+    floatexp reach = v.radius * floatexp(std::hypot((double) size.x,
+                                                    (double) size.y) /
+                                         window_radius);
+    mp_bitcnt_t bits = std::max(precision_bits(v.radius),
+                                std::max(v.center_r.get_prec(),
+                                         v.center_i.get_prec()));
+    return find_nucleus(v.center_r, v.center_i, reach, v.depth, bits,
+                        nucleus_r, nucleus_i, cancel);
+}
+
+// Renders frames on a thread of its own, so the window keeps drawing and
+// handling events while a frame is computed, and shows the tiles as they
+// finish. Starting a frame cancels the one in progress. The reference orbit of
+// the last frame is kept for as long as its reference stays the same, and only
+// gets more iterations added when the depth goes up.
+class renderer
+{
+public:
+    // keep_deltas keeps the final deltas of the pixels that don't escape,
+    // so that raising the depth only iterates the new part
+    renderer(thread_pool &pool, const vector<sf::Color> &gradient,
+             orbit_cache *cache = nullptr, bool keep_deltas = false)
+        : pool(pool), gradient(gradient), cache(cache),
+          keep_deltas(keep_deltas) {}
+
+    ~renderer() { stop(); }
+
+    // cancel the frame in progress, and wait until it has let go of the
+    // pixels
+    void stop()
+    {
+        cancel = true;
+        if (worker.joinable())
+            worker.join();
+        cancel = false;
+    }
+
+    void start(framebuffer *set, const sf::Vector2u &size, const view &v)
+    {
+        stop();
+        finished = false;
+        worker = std::thread(&renderer::run, this, set, size, v);
+    }
+
+    // wait for the frame in progress to finish
+    void wait()
+    {
+        if (worker.joinable())
+            worker.join();
+    }
+
+    // the results of the last frame, only to be read once it has finished
+    // or was stopped
+    const frame &result() const { return pixels; }
+
+    // whether the last frame started ran to the end
+    bool done() const { return finished; }
+
+    // turn the interior checks or subdivision on or off for the frames
+    // started from now on
+    void set_interior_checks(bool on) { interior_checks = on; }
+    void set_subdivide(bool on) { subdivide = on; }
+
+    // take grid x grid samples of the edge pixels of the frames started from
+    // now on, or none if grid is below 2
+    void set_antialias(int grid) { aa_grid = grid; }
+
+    // render the frames started from now on with the GPU kernel, or on the
+    // CPU only if it is null
+    void set_gpu(gpu_kernel *kernel) { gpu = kernel; }
+
+    // choose the depth of the frames started from now on from probes, in
+    // place of the depth of their view
+    void set_auto_depth(bool on) { auto_depth = on; }
+
+    // use the lowest period nucleus within reach of the frames started from
+    // now on as their reference, in place of their center
+    void set_nucleus(bool on) { nucleus = on; }
+
+private:
+    void run(framebuffer *set, sf::Vector2u size, view v)
+    {
+        auto begin = std::chrono::steady_clock::now();
+        double orbit_seconds = 0;
+        if (!choose_reference(size, v, &orbit_seconds))
+            return;
+        if (auto_depth && !probe_depth(size, v, &orbit_seconds))
+            return;
+        if (!prepare_orbit(reference_view(v), &orbit_seconds))
+            return;
+
+        // carry over whatever the last frame already has
+        frame next(size, v.depth, keep_deltas);
+        next.interior_checks = interior_checks;
+        next.subdivide = subdivide;
+        next.aa_grid = aa_grid;
+        next.stats.orbit_seconds = orbit_seconds;
+        next.stats.depth = v.depth;
+        next.stats.period = period;
+        next.shift = shift;
+        if (frame_view && !reuse_zoom(pixels, *frame_view, next, v))
+            reuse_depth(pixels, *frame_view, next, v);
+        pixels = std::move(next);
+        frame_view.reset(new view(v));
+
+        update(set, pixels, orbit, v, gradient, pool, cancel, gpu);
+        if (cancel)
+            return;
+        count_pixels(pixels);
+        pixels.stats.frame_seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - begin).count();
+        finished = true;
+    }
+
+    // Find the reference of v: with the nucleus search on, the lowest period
+    // nucleus within reach of the frame, which is in the set for as deep as
+    // it goes, otherwise (or if there is none) the center. The search is done
+    // again only when the center or the radius move, and adds its time to
+    // seconds. Returns false if cancelled.
+    bool choose_reference(const sf::Vector2u &size, const view &v,
+                          double *seconds)
+    {
+        bool same_view = searched &&
+            cmp(searched->center_r, v.center_r) == 0 &&
+            cmp(searched->center_i, v.center_i) == 0 &&
+            searched->radius.m == v.radius.m &&
+            searched->radius.e == v.radius.e;
+        if (!nucleus || !same_view)
+        {
+            searched.reset();
+            period = 0;
+            shift = 0;
+        }
+        if (!nucleus || same_view)
+            return true;
+
+        auto begin = std::chrono::steady_clock::now();
+        period = frame_nucleus(size, v, nucleus_r, nucleus_i, &cancel);
+        if (cancel)
+            return false;
+        if (period != 0)
+        {
+            mp_bitcnt_t bits = nucleus_r.get_prec();
+            mpf_class offset(0, bits);
+            offset = v.center_r - nucleus_r;
+            double shift_r = (floatexp::from_mpf(offset) / v.radius).get_d();
+            offset = v.center_i - nucleus_i;
+            double shift_i = (floatexp::from_mpf(offset) / v.radius).get_d();
+            shift = std::complex<double>(shift_r, shift_i);
+        }
+        searched.reset(new view(v));
+        *seconds += std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - begin).count();
+        return true;
+    }
+
+    // the view of the reference orbit of v
+    view reference_view(const view &v) const
+    {
+        if (period == 0)
+            return v;
+        return view{nucleus_r, nucleus_i, v.radius, v.depth};
+    }
+
+    // Make the orbit the one for v, keeping what it can of the last one, and
+    // add the time that took to seconds. Returns false if cancelled.
+    bool prepare_orbit(const view &v, double *seconds)
+    {
+        auto begin = std::chrono::steady_clock::now();
+        mp_bitcnt_t bits = precision_bits(v.radius);
+        bool same_center = orbit_view &&
+            cmp(orbit_view->center_r, v.center_r) == 0 &&
+            cmp(orbit_view->center_i, v.center_i) == 0 && orbit.bits >= bits;
+        if (same_center && v.depth < orbit_view->depth)
+        {
+            // less depth only needs the start of the orbit
+            if ((int) orbit.x.size() > v.depth)
+            {
+                orbit.x = orbit.x.prefix(v.depth);
+                orbit.escaped = false;
+                orbit.end.reset();
+            }
+            orbit_view.reset(new view(v));
+            return true;
+        }
+        else if (same_center && v.depth > orbit_view->depth &&
+                 (orbit.escaped || orbit.end))
+        {
+            // more depth goes on from the end of the orbit
+            if (!orbit.escaped)
+                extend_reference(orbit, v.center_r, v.center_i, v.depth,
+                                 &cancel);
+            if (cancel)
+                return false;
+        }
+        else if (!same_center || orbit_view->depth != v.depth)
+        {
+            orbit_view.reset();
+            if (cache)
+                orbit = cache->get(v.center_r, v.center_i, v.depth, bits,
+                                   &cancel);
+            else
+                orbit = deep_zoom_point(v.center_r, v.center_i, v.depth, bits,
+                                        &cancel);
+            if (cancel)
+                return false;
+        }
+        else
+            return true;
+        orbit_view.reset(new view(v));
+        *seconds += std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - begin).count();
+        return true;
+    }
+
+    // Choose the depth of v from renders of it at a fraction of the size,
+    // starting from min_auto_depth. While the probe needs more depth, the
+    // depth goes up and the probe is done again, unless the last time it went
+    // up pixels escaped but none in the new part; then it settles at twice the last
+    // escape the probe saw. The orbit grows with the probes, and the frame
+    // then only takes the part it needs. Returns false if cancelled.
+    bool probe_depth(const sf::Vector2u &size, view &v, double *seconds)
+    {
+        sf::Vector2u probe_size(std::max(size.x / probe_scale, 1u),
+                                std::max(size.y / probe_scale, 1u));
+        int previous = 0;
+        for (v.depth = min_auto_depth; ; )
+        {
+            if (!prepare_orbit(reference_view(v), seconds))
+                return false;
+            frame probe(probe_size, v.depth);
+            probe.interior_checks = interior_checks;
+            probe.shift = shift;
+            update(nullptr, probe, orbit, v, gradient, pool, cancel);
+            if (cancel)
+                return false;
+            int highest;
+            if (needs_depth(probe, &highest) && v.depth < max_auto_depth &&
+                (highest == 0 || highest > previous))
+            {
+                previous = v.depth;
+                v.depth = std::min(4 * v.depth, max_auto_depth);
+                continue;
+            }
+            v.depth = std::max(std::min(2 * highest, v.depth),
+                               min_auto_depth);
+            return true;
+        }
+    }
+
+    thread_pool &pool;
+    const vector<sf::Color> &gradient;
+    orbit_cache *cache;
+    bool keep_deltas;
+    std::atomic<bool> interior_checks {true};
+    std::atomic<bool> subdivide {false};
+    std::atomic<int> aa_grid {0};
+    std::atomic<bool> auto_depth {false};
+    std::atomic<bool> nucleus {false};
+    std::atomic<gpu_kernel *> gpu {nullptr};
+    std::thread worker;
+    std::atomic<bool> cancel {false};
+    std::atomic<bool> finished {false};
+
+    // the nucleus found for the last view searched, its period (0 for none,
+    // and the reference is the center) and the offset of the center from it
+    // in units of the radius
+    std::unique_ptr<view> searched;
+    mpf_class nucleus_r, nucleus_i;
+    int period = 0;
+    std::complex<double> shift;
+
+    // the reference orbit, and the view it was computed for
+    reference_orbit orbit;
+    std::unique_ptr<view> orbit_view;
+
+    // the results of the last frame, and its view
+    frame pixels;
+    std::unique_ptr<view> frame_view;
+};
+
+// Parameters
+
+// a string of digits, optionally followed by a decimal point and another
+// string of digits, optionally followed by an exponent
+bool valid_coordinate(const std::string &str)
+{
+    static const std::regex valid_float {"-?\\d+(.\\d*)?(e(\\+|-)?\\d+)?"};
+    return std::regex_match(str, valid_float);
+}
+
+// Set the center from decimal strings. Every digit given is kept, even past
+// what the radius needs (log2(10) is about 3.33 bits per digit).
+void set_center(mpf_class &center_r, mpf_class &center_i,
+                const std::string &r_str, const std::string &i_str,
+                const floatexp &radius)
+{
+    mp_bitcnt_t bits = precision_bits(radius);
+    bits = std::max<mp_bitcnt_t>(bits, 3.33 * r_str.size() + 16);
+    bits = std::max<mp_bitcnt_t>(bits, 3.33 * i_str.size() + 16);
+    center_r.set_prec(bits);
+    center_i.set_prec(bits);
+    center_r.set_str(r_str, 10);
+    center_i.set_str(i_str, 10);
+}
+
+vector<sf::Color> default_gradient()
+{
+    vector<sf::Color> gradient;
+    gradient.push_back(sf::Color::Black);
+    gradient.push_back(sf::Color::Blue);
+    gradient.push_back(sf::Color(128, 0, 255));
+    gradient.push_back(sf::Color::White);
+    gradient.push_back(sf::Color::Yellow);
+    gradient.push_back(sf::Color::Red);
+    return color_table(gradient);
+}
+
+// Rendering without a window
+
+// Write an uncompressed OpenEXR file with 32 bit float channels B, G and R
+// for the colors, and N for the smooth iteration count (-1 inside the set).
+// Assumes a little endian machine, like the format.
+bool write_exr(const std::string &path, const frame &pixels,
+               const vector<sf::Color> &gradient)
+{
+    std::ofstream out(path, std::ios::binary);
+    if (!out)
+        return false;
+    int w = pixels.size.x, h = pixels.size.y;
+    auto put = [&](const void *data, size_t n)
+    {
+        out.write((const char *) data, n);
+    };
+    auto put_int = [&](int32_t v) { put(&v, 4); };
+    auto put_float = [&](float v) { put(&v, 4); };
+    auto attribute = [&](const char *name, const char *type, int32_t bytes)
+    {
+        put(name, strlen(name) + 1);
+        put(type, strlen(type) + 1);
+        put_int(bytes);
+    };
+
+    const char magic[] = {0x76, 0x2f, 0x31, 0x01};
+    put(magic, 4);
+    put_int(2);     // version 2, single part scanline file
+
+    const char *channels[] = {"B", "G", "N", "R"};  // in alphabetical order
+    attribute("channels", "chlist", 4 * (2 + 16) + 1);
+    for (const char *name : channels)
+    {
+        put(name, 2);
+        put_int(2);                         // FLOAT
+        const char linear[4] = {0, 0, 0, 0};
+        put(linear, 4);
+        put_int(1);                         // x and y sampling
+        put_int(1);
+    }
+    put("", 1);
+    attribute("compression", "compression", 1);
+    put("", 1);                             // NO_COMPRESSION
+    int32_t window[] = {0, 0, w - 1, h - 1};
+    attribute("dataWindow", "box2i", 16);
+    put(window, 16);
+    attribute("displayWindow", "box2i", 16);
+    put(window, 16);
+    attribute("lineOrder", "lineOrder", 1);
+    put("", 1);                             // INCREASING_Y
+    attribute("pixelAspectRatio", "float", 4);
+    put_float(1);
+    attribute("screenWindowCenter", "v2f", 8);
+    put_float(0);
+    put_float(0);
+    attribute("screenWindowWidth", "float", 4);
+    put_float(1);
+    put("", 1);
+
+    // one scanline per block, each behind its y and data size
+    int32_t line_bytes = 4 * 4 * w;
+    uint64_t offset = (uint64_t) out.tellp() + 8 * (uint64_t) h;
+    for (int j = 0; j != h; ++j)
+    {
+        put(&offset, 8);
+        offset += 8 + line_bytes;
+    }
+    vector<float> line(4 * w);
+    for (int j = 0; j != h; ++j)
+    {
+        for (int i = 0; i != w; ++i)
+        {
+            int index = i + w * j;
+            int iter = pixels.iter[index];
+            sf::Color color = frame_color(pixels, gradient, index);
+            line[i] = color.b / 255.f;
+            line[w + i] = color.g / 255.f;
+            line[2 * w + i] = iter == pixels.max_iter ? -1 : pixels.nu[index];
+            line[3 * w + i] = color.r / 255.f;
+        }
+        put_int(j);
+        put_int(line_bytes);
+        put(line.data(), line_bytes);
+    }
+    return (bool) out;
+}
+
+// write a finished frame as EXR, or as whatever image SFML makes of the file
+// extension otherwise
+bool save_frame(const std::string &path, const frame &pixels,
+                const vector<sf::Color> &gradient)
+{
+    if (path.size() >= 4 && path.compare(path.size() - 4, 4, ".exr") == 0)
+        return write_exr(path, pixels, gradient);
+
+    sf::Image image;
+    image.create(pixels.size.x, pixels.size.y);
+    for (int j = 0; j != (int) pixels.size.y; ++j)
+    {
+        for (int i = 0; i != (int) pixels.size.x; ++i)
+        {
+            int index = i + pixels.size.x * j;
+            image.setPixel(i, j, frame_color(pixels, gradient, index));
+        }
+    }
+    return image.saveToFile(path);
+}
+
+// one image to render
+struct job
+{
+    std::string center_r = "0", center_i = "0";
+    floatexp radius = 2;
+    int depth = 1000;
+    sf::Vector2u size {1280, 720};
+    std::string out;
+
+    // a zoom animation goes in frames steps from radius to end_radius
+    int frames = 1;
+    floatexp end_radius;
+
+    bool interior_checks = true;
+    bool subdivide = false;
+    bool gpu = false;
+    int aa = 0;     // samples per side on the edges
+    bool auto_depth = false;
+    bool nucleus = false;   // reference on the lowest period nucleus
+
+    // HOST:PORT of the workers to render the tiles on, none to render here
+    vector<std::string> workers;
+};
+
+const char usage[] =
+    "usage: antelbrot [--center RE IM] [--radius R] [--depth N|auto]\n"
+    "                 [--size WxH] [--threads N] [--frames N --end-radius R]\n"
+    "                 [--no-interior] [--subdivide] [--gpu] [--aa N]\n"
+    "                 [--nucleus] [--workers HOST:PORT,...]\n"
+    "                 (--out FILE | --job FILE | --bench [--present] |\n"
+    "                  --worker PORT)\n"
+    "Renders without a window. FILE is written as OpenEXR if it ends in\n"
+    ".exr, and as PNG (or whatever else its extension says) otherwise. Every\n"
+    "line of a job file holds the options of one image, on top of the ones\n"
+    "given on the command line; empty lines and lines starting with # are\n"
+    "skipped. With --frames, the radius zooms exponentially over that many\n"
+    "frames from --radius to --end-radius, and FILE is a printf pattern for\n"
+    "the frame number, like zoom%05d.png. --gpu computes the pixels on the\n"
+    "GPU where it can. --aa N takes N x N jittered samples of each pixel on\n"
+    "an edge of the picture. --depth auto picks the depth from a small\n"
+    "render of the image first (not for animations). --nucleus uses the\n"
+    "lowest period nucleus within the image as the reference orbit, in place\n"
+    "of the center (not for animations either). --bench times the fixed\n"
+    "benchmark locations at the given size instead, and prints one JSON line\n"
+    "for each; the texture upload is timed when there is a display, which\n"
+    "--present insists on. --workers splits the image into tiles and renders them on\n"
+    "worker processes, started elsewhere with --worker PORT, which serve\n"
+    "tiles on that port until they are stopped.\n";
+
+// Read the options in args into j, and the job file, thread count,
+// benchmark flags and worker port if there are any. Prints what is wrong and
+// returns false on a bad option.
+bool parse_options(const vector<std::string> &args, job &j,
+                   std::string *job_file, unsigned *threads,
+                   bool *bench = nullptr, bool *present = nullptr,
+                   std::string *worker_port = nullptr)
+{
+    for (size_t k = 0; k != args.size(); ++k)
+    {
+        const std::string &option = args[k];
+        size_t left = args.size() - k - 1;
+        bool ok = true;
+        if (option == "--center" && left >= 2)
+        {
+            j.center_r = args[++k];
+            j.center_i = args[++k];
+            ok = valid_coordinate(j.center_r) && valid_coordinate(j.center_i);
+        }
+        else if (option == "--radius" && left >= 1)
+        {
+            std::istringstream in(args[++k]);
+            ok = (bool) (in >> j.radius) && j.radius > 0;
+        }
+        else if (option == "--depth" && left >= 1)
+        {
+            j.auto_depth = args[++k] == "auto";
+            if (!j.auto_depth)
+                j.depth = atoi(args[k].c_str());
+            ok = j.depth > 0;
+        }
+        else if (option == "--size" && left >= 1)
+        {
+            ok = sscanf(args[++k].c_str(), "%ux%u", &j.size.x, &j.size.y) == 2
+                 && j.size.x > 0 && j.size.y > 0;
+        }
+        else if (option == "--frames" && left >= 1)
+        {
+            j.frames = atoi(args[++k].c_str());
+            ok = j.frames > 0;
+        }
+        else if (option == "--end-radius" && left >= 1)
+        {
+            std::istringstream in(args[++k]);
+            ok = (bool) (in >> j.end_radius) && j.end_radius > 0;
+        }
+        else if (option == "--no-interior")
+        {
+            j.interior_checks = false;
+        }
+        else if (option == "--subdivide")
+        {
+            j.subdivide = true;
+        }
+        else if (option == "--gpu")
+        {
+            j.gpu = true;
+        }
+        else if (option == "--nucleus")
+        {
+            j.nucleus = true;
+        }
+        else if (option == "--aa" && left >= 1)
+        {
+            j.aa = atoi(args[++k].c_str());
+            ok = j.aa > 0 && j.aa <= 16;
+        }
+        else if (option == "--out" && left >= 1)
+        {
+            j.out = args[++k];
+        }
+        else if (option == "--job" && left >= 1 && job_file)
+        {
+            *job_file = args[++k];
+        }
+        else if (option == "--threads" && left >= 1 && threads)
+        {
+            *threads = atoi(args[++k].c_str());
+            ok = *threads > 0;
+        }
+        else if (option == "--bench" && bench)
+        {
+            *bench = true;
+        }
+        else if (option == "--present" && present)
+        {
+            *present = true;
+        }
+        else if (option == "--workers" && left >= 1)
+        {
+            std::istringstream list(args[++k]);
+            std::string address;
+            j.workers.clear();
+            while (getline(list, address, ','))
+            {
+                ok = ok && address.find(':') != std::string::npos;
+                j.workers.push_back(address);
+            }
+            ok = ok && !j.workers.empty();
+        }
+        else if (option == "--worker" && left >= 1 && worker_port)
+        {
+            *worker_port = args[++k];
+            ok = atoi(worker_port->c_str()) > 0;
+        }
+        else
+        {
+            std::cerr << "antelbrot: unknown or incomplete option " << option
+                      << endl;
+            return false;
+        }
+        if (!ok)
+        {
+            std::cerr << "antelbrot: bad value for " << option << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// frames of an animation that are rendered at the same time, so that the
+// parts of a frame that run on one thread (the series check, finding the
+// glitches, writing the file) overlap with the tiles of the others
+const int frames_in_flight = 3;
+
+// Render a zoom animation into the files of the job's out pattern. All frames
+// share the center, so one reference orbit at the precision of the deepest
+// frame, with its series coefficients, serves all of them. Frames are handed
+// out to frames_in_flight threads that share the pool, and each is written as
+// soon as it is done.
+bool run_animation(thread_pool &pool, orbit_cache *cache, gpu_kernel *gpu,
+                   const job &j, const vector<sf::Color> &gradient)
+{
+    if (j.end_radius.m == 0 || j.out.find('%') == std::string::npos)
+    {
+        std::cerr << "antelbrot: an animation needs --end-radius and a "
+                     "pattern like zoom%05d.png for --out" << endl;
+        return false;
+    }
+    if (j.auto_depth)
+    {
+        std::cerr << "antelbrot: an animation needs a fixed --depth" << endl;
+        return false;
+    }
+    if (j.nucleus)
+    {
+        std::cerr << "antelbrot: an animation keeps its reference at the "
+                     "center, so --nucleus doesn't apply" << endl;
+        return false;
+    }
+    floatexp deepest = (j.end_radius < j.radius) ? j.end_radius : j.radius;
+    view v {mpf_class(), mpf_class(), deepest, j.depth};
+    set_center(v.center_r, v.center_i, j.center_r, j.center_i, deepest);
+
+    auto begin = std::chrono::steady_clock::now();
+    mp_bitcnt_t bits = precision_bits(deepest);
+    reference_orbit orbit = cache ?
+        cache->get(v.center_r, v.center_i, j.depth, bits) :
+        deep_zoom_point(v.center_r, v.center_i, j.depth, bits);
+    cout << "orbit: " << orbit.x.size() << " iterations in "
+         << std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - begin).count()
+         << endl;
+
+    // the radius of frame k is radius * (end_radius / radius)^(k / (frames-1))
+    double log_zoom = std::log2(j.end_radius.m) + j.end_radius.e -
+                      std::log2(j.radius.m) - j.radius.e;
+    auto frame_radius = [&](int k)
+    {
+        if (j.frames == 1)
+            return j.radius;
+        double steps = log_zoom * k / (j.frames - 1);
+        double whole = std::floor(steps);
+        return j.radius * floatexp::normalise(std::exp2(steps - whole),
+                                              (int64_t) whole);
+    };
+
+    std::atomic<int> next {0};
+    std::atomic<int> failed {0};
+    std::mutex output;
+    std::atomic<bool> cancel {false};
+    auto drive = [&]
+    {
+        std::vector<char> path(j.out.size() + 32);
+        for (int k = next++; k < j.frames; k = next++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            view frame_view {v.center_r, v.center_i, frame_radius(k), j.depth};
+            frame pixels(j.size, j.depth);
+            pixels.interior_checks = j.interior_checks;
+            pixels.subdivide = j.subdivide;
+            pixels.aa_grid = j.aa;
+            update(nullptr, pixels, orbit, frame_view, gradient, pool, cancel,
+                   j.gpu ? gpu : nullptr);
+
+            snprintf(path.data(), path.size(), j.out.c_str(), k);
+            bool saved = save_frame(path.data(), pixels, gradient);
+            double seconds = std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - start).count();
+
+            std::lock_guard<std::mutex> lock(output);
+            if (!saved)
+            {
+                std::cerr << "antelbrot: could not write " << path.data()
+                          << endl;
+                ++failed;
+                continue;
+            }
+            cout << path.data() << ": zoom: " << frame_view.radius
+                 << ". time: " << seconds << endl;
+        }
+    };
+    vector<std::thread> drivers;
+    for (int t = 0; t != frames_in_flight; ++t)
+        drivers.emplace_back(drive);
+    for (auto &t : drivers)
+        t.join();
+    return failed == 0;
+}
+
+// Distributed rendering
+
+// An image too big for one machine can be split among workers on others (or
+// on the same one). The coordinator computes the reference orbit once, sends
+// it to every worker, and hands out the tiles of the image one at a time; the
+// workers send back the iteration counts of their tiles, and the coordinator
+// stitches them into the image. Messages go over TCP, each a header and then
+// its payload: a line of text, and for orbits and results zlib compressed
+// data after it. Both ends are assumed to be the same kind of little endian
+// machine, like the files.
+
+// the tiles handed out, in pixels on a side
+const int remote_tile_size = 512;
+
+// A tile is tried on at most this many workers. After that, and for the
+// tiles left when no worker is, the coordinator renders it itself.
+const int tile_attempts = 3;
+
+// a worker whose connection fails gets this many new ones in a row before it
+// is given up
+const int worker_reconnects = 3;
+
+// how long either end waits on the other before it counts as gone
+const int network_timeout_seconds = 600;
+
+const char network_magic[8] = "ANTNET2";
+
+enum message_type : uint64_t
+{
+    orbit_message = 1,      // the reference orbit, but for its points
+    tile_message,           // a tile to render
+    result_message,         // the pixels of a tile
+    orbit_points_message,   // the points of the orbit, right after it
+    aa_message,             // a tile to anti-alias, with its fixed counts
+};
+
+// Messages are checked against the most they can hold before anything is
+// allocated for them: text (a tile, or an orbit but for its points) up to
+// max_text_message, which takes centers of a few hundred thousand digits,
+// and the compressed points of an orbit or pixels of a tile by their count.
+const uint64_t max_text_message = 1 << 20;
+
+uint64_t orbit_points_limit(size_t count)
+{
+    return compressBound(count * sizeof(std::complex<double>));
+}
+
+// a message is read in pieces of this many bytes
+const size_t receive_piece = size_t(1) << 20;
+
+// a TCP connection, closed when this goes
+class connection
+{
+public:
+    connection() {}
+    explicit connection(int fd) : fd(fd) { set_timeout(); }
+    ~connection() { disconnect(); }
+
+    connection(const connection &) = delete;
+    connection &operator=(const connection &) = delete;
+
+    // connect to HOST:PORT
+    bool connect_to(const std::string &address)
+    {
+        disconnect();
+        size_t colon = address.rfind(':');
+        if (colon == std::string::npos)
+            return false;
+        addrinfo hints = {};
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo *found;
+        if (getaddrinfo(address.substr(0, colon).c_str(),
+                        address.substr(colon + 1).c_str(), &hints,
+                        &found) != 0)
+            return false;
+        for (addrinfo *a = found; a && fd < 0; a = a->ai_next)
+        {
+            fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+            if (fd >= 0 && connect(fd, a->ai_addr, a->ai_addrlen) != 0)
+                disconnect();
+        }
+        freeaddrinfo(found);
+        set_timeout();
+        return fd >= 0;
+    }
+
+    void disconnect()
+    {
+        if (fd >= 0)
+            close(fd);
+        fd = -1;
+    }
+
+    bool connected() const { return fd >= 0; }
+
+    bool send_message(uint64_t type, const std::string &payload)
+    {
+        header h;
+        memcpy(h.magic, network_magic, 8);
+        h.type = type;
+        h.size = payload.size();
+        return put(&h, sizeof h) && put(payload.data(), payload.size());
+    }
+
+    // False if the connection fails, or what comes isn't a message of at
+    // most limit bytes. The payload grows as its bytes come in, so a peer
+    // has to send as much as it makes this allocate.
+    bool receive_message(uint64_t &type, std::string &payload, uint64_t limit)
+    {
+        header h;
+        if (!get(&h, sizeof h) || memcmp(h.magic, network_magic, 8) != 0 ||
+            h.size > limit)
+            return false;
+        type = h.type;
+        payload.clear();
+        while (payload.size() != h.size)
+        {
+            size_t done = payload.size();
+            payload.resize(done + std::min<uint64_t>(h.size - done,
+                                                     receive_piece));
+            if (!get(&payload[done], payload.size() - done))
+                return false;
+        }
+        return true;
+    }
+
+private:
+    struct header
+    {
+        char magic[8];
+        uint64_t type;
+        uint64_t size;      // of the payload
+    };
+
+
+    void set_timeout()
+    {
+        if (fd < 0)
+            return;
+        timeval limit = {network_timeout_seconds, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &limit, sizeof limit);
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &limit, sizeof limit);
+    }
+
+    bool put(const void *data, size_t size)
+    {
+        const char *bytes = (const char *) data;
+        while (size != 0)
+        {
+            ssize_t n = send(fd, bytes, size, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            bytes += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    bool get(void *data, size_t size)
+    {
+        char *bytes = (char *) data;
+        while (size != 0)
+        {
+            ssize_t n = recv(fd, bytes, size, 0);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            bytes += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    int fd = -1;
+};
+
+// data compressed with zlib, at its fastest level
+std::string deflate_bytes(const void *data, size_t size)
 {
-    int r = color1.r + (color2.r - color1.r) * mid;
-    int g = color1.g + (color2.g - color1.g) * mid;
-    int b = color1.b + (color2.b - color1.b) * mid;
-    return sf::Color(r, g, b);
+    uLongf length = compressBound(size);
+    std::string out(length, '\0');
+    if (compress2((Bytef *) &out[0], &length, (const Bytef *) data, size,
+                  Z_BEST_SPEED) != Z_OK)
+        return std::string();
+    out.resize(length);
+    return out;
 }
 
-// This function takes a vector of colors, and returns a gradient based on
-// the original vector
-vector<sf::Color> color_table(const vector<sf::Color> &gradient)
+// Undo deflate_bytes, handing the data to take in pieces of inflate_piece
+// bytes (the last one can be shorter). Returns false if the data is cut
+// short or isn't zlib.
+const size_t inflate_piece = size_t(1) << 20;
+
+bool inflate_bytes(const char *data, size_t size,
+                   const std::function<void(const char *, size_t)> &take)
 {
-    vector<sf::Color> v;
-    double d = 0;
-    for (auto i = gradient.begin(); i != gradient.end(); ++i)
+    z_stream stream = {};
+    if (inflateInit(&stream) != Z_OK)
+        return false;
+    vector<char> piece(inflate_piece);
+    stream.next_out = (Bytef *) piece.data();
+    stream.avail_out = piece.size();
+    int status = Z_OK;
+    while (status == Z_OK)
     {
-        // interpolate between this and the next color of the input gradient
-        auto next = (i + 1 == gradient.end()) ? gradient.begin() : i + 1;
-        for (double d = 0; d < 1; d += 0.01)
-            v.push_back(interpolate(*i, *next, d));
+        // zlib counts its input in 32 bits
+        if (stream.avail_in == 0)
+        {
+            uInt n = (uInt) std::min<size_t>(size, 1 << 30);
+            stream.next_in = (Bytef *) data;
+            stream.avail_in = n;
+            data += n;
+            size -= n;
+        }
+        status = inflate(&stream, Z_NO_FLUSH);
+        if (stream.avail_out == 0 || status == Z_STREAM_END)
+        {
+            take(piece.data(), piece.size() - stream.avail_out);
+            stream.next_out = (Bytef *) piece.data();
+            stream.avail_out = piece.size();
+        }
     }
-    return v;
+    inflateEnd(&stream);
+    return status == Z_STREAM_END;
 }
 
-sf::Color palette(const vector<sf::Color> &gradient, double zn_size, int iter)
+// Split a payload into its line of text and the compressed data after it.
+// Returns false if there is no line.
+bool split_payload(const std::string &payload, std::istringstream &text,
+                   size_t *data)
 {
-    // use smooth coloring
-    double nu = iter - std::log2(std::log2(zn_size));
-    int i = (int) (nu * 10) % gradient.size();
+    size_t end = payload.find('\n');
+    if (end == std::string::npos)
+        return false;
+    text.str(payload.substr(0, end));
+    *data = end + 1;
+    return true;
+}
 
-    return gradient[i];
+// The orbit as a message: its precision, length and whether it escaped, and
+// the exact reference it belongs to. Its points go in an orbit points message
+// after it, so that their size can be checked against the length.
+std::string orbit_payload(const reference_orbit &orbit, const mpf_class &ref_r,
+                          const mpf_class &ref_i)
+{
+    return std::to_string(orbit.bits) + " " +
+           std::to_string(orbit.x.size()) + " " +
+           std::to_string((int) orbit.escaped) + " " + mpf_text(ref_r) + " " +
+           mpf_text(ref_i);
 }
 
-// Math algorithms
+std::string orbit_points_payload(const reference_orbit &orbit)
+{
+    return deflate_bytes(orbit.x.data(),
+                         orbit.x.size() * sizeof(std::complex<double>));
+}
 
-// high precision point used for perturbation theory method
-// produces a list of iteration values used to compute the surrounding points
-vector<std::complex<double>> deep_zoom_point(const mpf_class &center_r,
-                          const mpf_class &center_i, int depth)
+// The length of the orbit of an orbit message, 0 if it is bad or longer than
+// a depth (an int) can iterate through.
+size_t orbit_length(const std::string &payload)
+{
+    std::istringstream text(payload);
+    mp_bitcnt_t bits;
+    size_t count;
+    if (!(text >> bits >> count) ||
+        count > (size_t) std::numeric_limits<int>::max())
+        return 0;
+    return count;
+}
+
+// Read an orbit message and the points message after it, and compute the
+// series of the orbit from its points. Returns false if they are bad.
+bool read_orbit(const std::string &payload, const std::string &points_payload,
+                reference_orbit &orbit, mpf_class &ref_r, mpf_class &ref_i)
+{
+    std::istringstream text(payload);
+    size_t count = orbit_length(payload);
+    int escaped;
+    std::string text_r, text_i;
+    if (count == 0 ||
+        !(text >> orbit.bits >> count >> escaped >> text_r >> text_i))
+        return false;
+
+    // Nothing is allocated for the points on the word of the message: its
+    // data is inflated once to measure it, and has to hold exactly count
+    // points.
+    const char *bytes = points_payload.data();
+    size_t size = points_payload.size(), inflated = 0;
+    if (!inflate_bytes(bytes, size,
+                       [&](const char *, size_t n) { inflated += n; }) ||
+        inflated != count * sizeof(std::complex<double>))
+        return false;
+    ref_r = mpf_from_text(text_r, orbit.bits);
+    ref_i = mpf_from_text(text_i, orbit.bits);
+
+    // the pieces hold whole points, inflate_piece being a multiple of them
+    orbit_buffer points(count);
+    auto take = [&](const char *bytes, size_t size)
+    {
+        std::complex<double> x;
+        for (size_t k = 0; k + sizeof x <= size; k += sizeof x)
+        {
+            memcpy(&x, bytes + k, sizeof x);
+            if (points.size() < count)
+                points.push_back(x);
+        }
+    };
+    if (!inflate_bytes(bytes, size, take) || points.size() != count)
+        return false;
+    orbit.x = points.points();
+    orbit.escaped = escaped;
+    orbit.end.reset();
+    orbit.a.clear();
+    orbit.b.clear();
+    orbit.c.clear();
+    series_coefficients(orbit);
+    return true;
+}
+
+// A tile of an image: the center, radius and options of the image, and the
+// bounds of the tile in its pixels.
+struct tile_job
 {
-    vector<std::complex<double>> v;
-    mpf_class xn_r = center_r;
-    mpf_class xn_i = center_i;
+    std::string center_r, center_i;     // exact, as mpf_text
+    floatexp radius;
+    int depth = 0;
+    sf::Vector2u size;                  // of the whole image
+    int x = 0, y = 0, w = 0, h = 0;
+    bool interior_checks = true;
+    bool subdivide = false;
+    int aa = 0;
 
-    for (int i = 0; i != depth; ++i)
+    std::string text() const
     {
-        // pre multiply by two
-        mpf_class re = xn_r + xn_r;
-        mpf_class im = xn_i + xn_i;
+        // the radius goes exactly, as a hexadecimal mantissa and exponent
+        char radius_text[64];
+        snprintf(radius_text, sizeof radius_text, "%a %lld", radius.m,
+                 (long long) radius.e);
+        std::ostringstream out;
+        out << center_r << " " << center_i << " " << radius_text << " "
+            << depth << " " << size.x << " " << size.y << " " << x << " "
+            << y << " " << w << " " << h << " " << interior_checks << " "
+            << subdivide << " " << aa;
+        return out.str();
+    }
 
-        std::complex<double> c(re.get_d(), im.get_d());
+    // false if the text isn't a tile, or the tile isn't within the image
+    bool parse(const std::string &text)
+    {
+        std::istringstream in(text);
+        std::string m;
+        long long e;
+        if (!(in >> center_r >> center_i >> m >> e >> depth >> size.x >>
+              size.y >> x >> y >> w >> h >> interior_checks >> subdivide >>
+              aa))
+            return false;
+        radius = floatexp::normalise(strtod(m.c_str(), nullptr), e);
+        return radius > 0 && depth > 0 && w > 0 && h > 0 && x >= 0 &&
+               y >= 0 && x + w <= (int) size.x && y + h <= (int) size.y;
+    }
+};
 
-        v.push_back(c);
+// The pixels of the image that tile t is rendered on: the tile with a
+// margin of a pixel where the image goes on, so that the anti-aliasing sees
+// the same neighbours at its edges as in the whole image.
+struct tile_window
+{
+    int x0, y0;
+    sf::Vector2u size;
 
-        // make sure our numbers don't get too big
-        if (re > 1024 || im > 1024 || re < -1024 || im < -1024)
-            return v;
+    explicit tile_window(const tile_job &t)
+        : x0(std::max(t.x - 1, 0)), y0(std::max(t.y - 1, 0))
+    {
+        int x1 = std::min(t.x + t.w + 1, (int) t.size.x);
+        int y1 = std::min(t.y + t.h + 1, (int) t.size.y);
+        size = sf::Vector2u(x1 - x0, y1 - y0);
+    }
+};
+
+// Render the tile of t against orbit, whose reference is ref_r + i ref_i,
+// into tile. It is rendered as a frame of its own on its window, and the
+// margin is cut off after. The glitches are kept, for the coordinator to fix
+// over the whole image like a single machine does, so no reference orbit is
+// computed here. Without counts, that is all, and the tile gets no extra
+// samples; with the counts of the window once they are fixed, only the
+// anti-aliasing is left to do. Returns false if cancelled.
+bool render_tile_job(const tile_job &t, const reference_orbit &orbit,
+                     const mpf_class &ref_r, const mpf_class &ref_i,
+                     const vector<sf::Color> &gradient, thread_pool &pool,
+                     const std::atomic<bool> &cancel, frame &tile,
+                     const frame *counts = nullptr)
+{
+    tile_window window(t);
+    int x0 = window.x0, y0 = window.y0;
+    sf::Vector2u size = window.size;
+
+    // The radius goes down with the window, so the pixels stay the size
+    // they are in the image, and the center moves to the middle of the tile.
+    // shift is then the offset of that from the reference.
+    floatexp radius = t.radius * floatexp((double) std::min(size.x, size.y) /
+                                          std::min(t.size.x, t.size.y));
+    complex_t<double> middle = pixel_offset(2 * x0 + (int) size.x -
+                                            (int) t.size.x,
+                                            2 * y0 + (int) size.y -
+                                            (int) t.size.y, t.size, 1.0);
+    mp_bitcnt_t bits = std::max(precision_bits(radius), orbit.bits);
+    view v {mpf_from_text(t.center_r, bits), mpf_from_text(t.center_i, bits),
+            radius, t.depth};
+    v.center_r += (t.radius * floatexp(middle.re)).get_mpf(bits);
+    v.center_i += (t.radius * floatexp(middle.im)).get_mpf(bits);
 
-        // calculate next iteration, remember re = 2 * xn_r
-        xn_r = xn_r * xn_r - xn_i * xn_i + center_r;
-        xn_i = re * xn_i + center_i;
+    frame pixels(size, t.depth);
+    pixels.interior_checks = t.interior_checks;
+    pixels.subdivide = t.subdivide;
+    pixels.keep_glitches = true;
+    if (counts)
+    {
+        pixels.iter = counts->iter;
+        pixels.nu = counts->nu;
+        pixels.aa_grid = t.aa;
     }
-    return v;
+    mpf_class offset(0, bits);
+    offset = v.center_r - ref_r;
+    double shift_r = (floatexp::from_mpf(offset) / radius).get_d();
+    offset = v.center_i - ref_i;
+    double shift_i = (floatexp::from_mpf(offset) / radius).get_d();
+    pixels.shift = std::complex<double>(shift_r, shift_i);
+    update(nullptr, pixels, orbit, v, gradient, pool, cancel);
+    if (cancel)
+        return false;
+
+    tile = frame(sf::Vector2u(t.w, t.h), pixels.max_iter);
+    if (!pixels.aa.empty())
+        tile.aa.resize(tile.iter.size());
+    for (int j = 0; j != t.h; ++j)
+    {
+        for (int i = 0; i != t.w; ++i)
+        {
+            int from = (t.x - x0 + i) + size.x * (t.y - y0 + j);
+            int to = i + t.w * j;
+            tile.iter[to] = pixels.iter[from];
+            tile.nu[to] = pixels.nu[from];
+            if (!pixels.aa.empty())
+                tile.aa[to] = pixels.aa[from];
+        }
+    }
+    return true;
 }
 
+// A rendered tile as a message: its bounds, depth and whether it has
+// anti-aliased colors, then its iteration counts, smooth counts and colors.
+std::string result_payload(const tile_job &t, const frame &tile)
+{
+    size_t n = tile.iter.size();
+    std::string data(n * (sizeof(int) + sizeof(float)) +
+                     tile.aa.size() * sizeof(sf::Color), '\0');
+    char *at = &data[0];
+    memcpy(at, tile.iter.data(), n * sizeof(int));
+    at += n * sizeof(int);
+    memcpy(at, tile.nu.data(), n * sizeof(float));
+    at += n * sizeof(float);
+    if (!tile.aa.empty())
+        memcpy(at, tile.aa.data(), n * sizeof(sf::Color));
+    std::ostringstream text;
+    text << t.x << " " << t.y << " " << t.w << " " << t.h << " "
+         << tile.max_iter << " " << !tile.aa.empty() << "\n";
+    return text.str() + deflate_bytes(data.data(), data.size());
+}
 
-// Color the pixel (i,j)
-sf::Color pt(const int &i, const int &j, const vector<std::complex<double>> &x,
-             const sf::Vector2u &size, const double &radius,
-             const vector<sf::Color> &gradient)
+// the most a result message of tile t can hold: its line and the compressed
+// counts and colors of its pixels
+uint64_t result_limit(const tile_job &t)
 {
-    int window_radius = (size.x < size.y) ? size.x : size.y;
-    // find the complex number at the center of this pixel
-    std::complex<double> d0 (radius * (2 * i - (int) size.x) / window_radius,
-                             -radius * (2 * j - (int) size.y) / window_radius);
+    uLong pixels = (uLong) t.w * t.h;
+    return 256 + compressBound(pixels * (sizeof(int) + sizeof(float) +
+                                         sizeof(sf::Color)));
+}
+
+// Read the result of tile t. Returns false if it is bad or is for another
+// tile or depth.
+bool read_result(const std::string &payload, const tile_job &t, int max_iter,
+                 frame &tile)
+{
+    std::istringstream text;
+    size_t data;
+    int x, y, w, h, depth;
+    bool aa;
+    if (!split_payload(payload, text, &data) ||
+        !(text >> x >> y >> w >> h >> depth >> aa) || x != t.x || y != t.y ||
+        w != t.w || h != t.h || depth != max_iter)
+        return false;
+    tile = frame(sf::Vector2u(w, h), depth);
+    size_t n = tile.iter.size();
+    if (aa)
+        tile.aa.resize(n);
+    std::string bytes;
+    auto take = [&](const char *piece, size_t size)
+    {
+        bytes.append(piece, size);
+    };
+    if (!inflate_bytes(payload.data() + data, payload.size() - data, take) ||
+        bytes.size() != n * (sizeof(int) + sizeof(float)) +
+                        tile.aa.size() * sizeof(sf::Color))
+        return false;
+    const char *at = bytes.data();
+    memcpy(tile.iter.data(), at, n * sizeof(int));
+    at += n * sizeof(int);
+    memcpy(tile.nu.data(), at, n * sizeof(float));
+    at += n * sizeof(float);
+    if (aa)
+        memcpy(tile.aa.data(), at, n * sizeof(sf::Color));
+    return true;
+}
+
+// the iteration counts and smooth counts of the window of tile t in the image
+frame window_counts(const tile_job &t, const frame &image)
+{
+    tile_window window(t);
+    frame counts(window.size, image.max_iter);
+    for (int j = 0; j != (int) window.size.y; ++j)
+    {
+        int from = window.x0 + image.size.x * (window.y0 + j);
+        std::copy_n(image.iter.begin() + from, window.size.x,
+                    counts.iter.begin() + window.size.x * j);
+        std::copy_n(image.nu.begin() + from, window.size.x,
+                    counts.nu.begin() + window.size.x * j);
+    }
+    return counts;
+}
 
-    int iter = 0;
+// The tile t to anti-alias as a message: the tile, then the counts of its
+// window in the image.
+std::string aa_payload(const tile_job &t, const frame &image)
+{
+    frame counts = window_counts(t, image);
+    size_t n = counts.iter.size();
+    std::string data((const char *) counts.iter.data(), n * sizeof(int));
+    data.append((const char *) counts.nu.data(), n * sizeof(float));
+    return t.text() + "\n" + deflate_bytes(data.data(), data.size());
+}
 
-    int max_iter = x.size();
+// the most an anti-aliasing message can hold, for any of the tiles handed out
+uint64_t aa_limit()
+{
+    uLong pixels = (uLong) (remote_tile_size + 2) * (remote_tile_size + 2);
+    return max_text_message +
+           compressBound(pixels * (sizeof(int) + sizeof(float)));
+}
 
-    double zn_size;
-    // run the iteration loop
-    std::complex<double> dn = d0;
-    do
+// Read an anti-aliasing message into its tile and the counts of its window.
+// Returns false if it is bad.
+bool read_aa(const std::string &payload, tile_job &t, frame &counts)
+{
+    std::istringstream text;
+    size_t data;
+    if (!split_payload(payload, text, &data) || !t.parse(text.str()) ||
+        t.w > remote_tile_size || t.h > remote_tile_size)
+        return false;
+    tile_window window(t);
+    counts = frame(window.size, t.depth);
+    size_t n = counts.iter.size();
+    std::string bytes;
+    bool fits = true;
+    auto take = [&](const char *piece, size_t size)
     {
-        dn *= x[iter] + dn;
-        dn += d0;
-        ++iter;
-        zn_size = std::norm(x[iter] * 0.5 + dn);
+        fits = fits && bytes.size() + size <= n * (sizeof(int) + sizeof(float));
+        if (fits)
+            bytes.append(piece, size);
+    };
+    if (!inflate_bytes(payload.data() + data, payload.size() - data, take) ||
+        !fits || bytes.size() != n * (sizeof(int) + sizeof(float)))
+        return false;
+    memcpy(counts.iter.data(), bytes.data(), n * sizeof(int));
+    memcpy(counts.nu.data(), bytes.data() + n * sizeof(int),
+           n * sizeof(float));
+    return true;
+}
 
-        // use bailout radius of 256 for smooth coloring.
+// Copy a rendered tile into its place in the image, or only its colors,
+// for a tile anti-aliased on the counts the image has.
+void stitch_tile(frame &image, const tile_job &t, const frame &tile,
+                 bool colors_only = false)
+{
+    for (int j = 0; j != t.h; ++j)
+    {
+        int to = t.x + image.size.x * (t.y + j);
+        if (!colors_only)
+        {
+            std::copy_n(tile.iter.begin() + t.w * j, t.w,
+                        image.iter.begin() + to);
+            std::copy_n(tile.nu.begin() + t.w * j, t.w, image.nu.begin() + to);
+        }
+        if (!tile.aa.empty() && !image.aa.empty())
+            std::copy_n(tile.aa.begin() + t.w * j, t.w,
+                        image.aa.begin() + to);
+    }
+}
+
+// Render the image of j on the workers of its list and write it, printing a
+// line about it to stdout. The reference is chosen like the renderer does,
+// and its orbit comes from the cache if there is one. Every worker gets a
+// thread here that sends it the orbit and then one tile after another. A
+// tile that fails goes back to the others, and the worker gets a new
+// connection (and the orbit again). The glitches are fixed here, between
+// the rendering and the anti-aliasing rounds.
+bool run_distributed(thread_pool &pool, orbit_cache *cache, const job &j,
+                     const vector<sf::Color> &gradient)
+{
+    if (j.frames > 1 || j.auto_depth)
+    {
+        std::cerr << "antelbrot: --workers renders single images with a "
+                     "fixed --depth" << endl;
+        return false;
+    }
+    auto begin = std::chrono::steady_clock::now();
+    view v {mpf_class(), mpf_class(), j.radius, j.depth};
+    set_center(v.center_r, v.center_i, j.center_r, j.center_i, j.radius);
+    mpf_class ref_r = v.center_r, ref_i = v.center_i;
+    int period = 0;
+    if (j.nucleus)
+    {
+        mpf_class nucleus_r, nucleus_i;
+        period = frame_nucleus(j.size, v, nucleus_r, nucleus_i);
+        if (period != 0)
+        {
+            ref_r = nucleus_r;
+            ref_i = nucleus_i;
+        }
     }
-    while (zn_size < 256 && iter < max_iter);
+    mp_bitcnt_t bits = precision_bits(j.radius);
+    reference_orbit orbit = cache ?
+        cache->get(ref_r, ref_i, j.depth, bits) :
+        deep_zoom_point(ref_r, ref_i, j.depth, bits);
+    std::string orbit_message_payload = orbit_payload(orbit, ref_r, ref_i);
+    std::string orbit_points = orbit_points_payload(orbit);
 
+    vector<tile_job> tiles;
+    for (int y = 0; y < (int) j.size.y; y += remote_tile_size)
+    {
+        for (int x = 0; x < (int) j.size.x; x += remote_tile_size)
+        {
+            tile_job t;
+            t.center_r = mpf_text(v.center_r);
+            t.center_i = mpf_text(v.center_i);
+            t.radius = j.radius;
+            t.depth = j.depth;
+            t.size = j.size;
+            t.x = x;
+            t.y = y;
+            t.w = std::min(remote_tile_size, (int) j.size.x - x);
+            t.h = std::min(remote_tile_size, (int) j.size.y - y);
+            t.interior_checks = j.interior_checks;
+            t.subdivide = j.subdivide;
+            t.aa = j.aa;
+            tiles.push_back(t);
+        }
+    }
 
-    // color according to iteration using logarithmic smoothing
-    sf::Color color = palette(gradient, zn_size, iter);
-    if (iter == max_iter)
-        return sf::Color::Black;    // if it's in the set, color black
+    frame image(j.size, j.depth);
+    image.interior_checks = j.interior_checks;
+    if (j.aa >= 2)
+        image.aa.assign(image.iter.size(), sf::Color::Transparent);
+
+    // Hand out every tile as a message of the given type, and stitch what
+    // comes back. Returns false if a tile can't be done here either. The
+    // tiles rendered by each worker and here are counted in the first round.
+    vector<int> rendered(j.workers.size(), 0);
+    int retried = 0, here = 0;
+    std::atomic<bool> cancel {false};
+    auto hand_out = [&](uint64_t type) -> bool
+    {
+        // the tiles waiting for a worker, the ones left to the coordinator,
+        // and how many are out on workers, any of which can still come back
+        std::deque<int> waiting;
+        for (size_t k = 0; k != tiles.size(); ++k)
+            waiting.push_back(k);
+        vector<int> local, attempts(tiles.size(), 0);
+        int out = 0;
+        std::mutex lock;
+        std::condition_variable changed;
 
-    return color;
+        auto drive = [&](size_t worker)
+        {
+            const std::string &address = j.workers[worker];
+            connection link;
+            int reconnects = 0, done = 0;
+            while (true)
+            {
+                if (!link.connected())
+                {
+                    if (reconnects++ > worker_reconnects)
+                        break;
+                    if (!link.connect_to(address) ||
+                        !link.send_message(orbit_message,
+                                           orbit_message_payload) ||
+                        !link.send_message(orbit_points_message, orbit_points))
+                    {
+                        link.disconnect();
+                        std::this_thread::sleep_for(std::chrono::seconds(1));
+                        continue;
+                    }
+                }
+
+                int k;
+                {
+                    std::unique_lock<std::mutex> hold(lock);
+                    changed.wait(hold, [&]
+                    {
+                        return !waiting.empty() || out == 0;
+                    });
+                    if (waiting.empty())
+                        break;
+                    k = waiting.front();
+                    waiting.pop_front();
+                    ++out;
+                }
+
+                frame tile;
+                uint64_t reply;
+                std::string payload = type == tile_message ?
+                    tiles[k].text() : aa_payload(tiles[k], image);
+                bool ok = link.send_message(type, payload) &&
+                          link.receive_message(reply, payload,
+                                               result_limit(tiles[k])) &&
+                          reply == result_message &&
+                          read_result(payload, tiles[k], image.max_iter, tile);
+                if (ok)
+                    stitch_tile(image, tiles[k], tile, type == aa_message);
+
+                std::lock_guard<std::mutex> hold(lock);
+                --out;
+                if (ok)
+                {
+                    rendered[worker] += type == tile_message;
+                    ++done;
+                    reconnects = 0;
+                }
+                else
+                {
+                    std::cerr << "antelbrot: tile at " << tiles[k].x << ", "
+                              << tiles[k].y << " failed on " << address
+                              << endl;
+                    ++retried;
+                    if (++attempts[k] < tile_attempts)
+                        waiting.push_back(k);
+                    else
+                        local.push_back(k);
+                    link.disconnect();
+                }
+                changed.notify_all();
+            }
+            std::lock_guard<std::mutex> hold(lock);
+            if (done == 0)
+                std::cerr << "antelbrot: could not use worker " << address
+                          << endl;
+            changed.notify_all();
+        };
+        vector<std::thread> drivers;
+        for (size_t worker = 0; worker != j.workers.size(); ++worker)
+            drivers.emplace_back(drive, worker);
+        for (auto &t : drivers)
+            t.join();
+
+        // whatever no worker could do
+        local.insert(local.end(), waiting.begin(), waiting.end());
+        if (type == tile_message)
+            here = local.size();
+        for (int k : local)
+        {
+            frame tile, counts;
+            if (type == aa_message)
+                counts = window_counts(tiles[k], image);
+            if (!render_tile_job(tiles[k], orbit, ref_r, ref_i, gradient,
+                                 pool, cancel, tile,
+                                 type == aa_message ? &counts : nullptr))
+            {
+                // rather no image than one with a hole in it
+                std::cerr << "antelbrot: could not render the tile at "
+                          << tiles[k].x << ", " << tiles[k].y << " of "
+                          << j.out << endl;
+                return false;
+            }
+            stitch_tile(image, tiles[k], tile, type == aa_message);
+        }
+        return true;
+    };
+
+    // The tiles come back with their glitches, which are fixed here over the
+    // whole image, so that the references are chosen, and limited, like on
+    // one machine, and the workers never compute an orbit. The anti-aliasing
+    // has to see the fixed counts, so it goes out in a second round.
+    if (!hand_out(tile_message))
+        return false;
+    fix_glitches(nullptr, image, v, gradient, pool, cancel);
+    if (j.aa >= 2 && !hand_out(aa_message))
+        return false;
+
+    bool saved = save_frame(j.out, image, gradient);
+    double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - begin).count();
+    if (!saved)
+    {
+        std::cerr << "antelbrot: could not write " << j.out << endl;
+        return false;
+    }
+    cout << j.out << ": center: " << v.center_r << " + i " << v.center_i
+         << ". zoom: " << j.radius << ". depth: " << j.depth << ". time: "
+         << seconds << ". ";
+    if (period != 0)
+        cout << "reference: period " << period << " nucleus, ";
+    cout << "tiles: " << tiles.size() << " (";
+    for (size_t worker = 0; worker != j.workers.size(); ++worker)
+        cout << j.workers[worker] << ": " << rendered[worker] << ", ";
+    cout << "here: " << here << "), retried: " << retried << ", glitches: "
+         << image.stats.glitches << " (" << image.stats.references
+         << " references, " << image.stats.filled << " filled)" << endl;
+    return true;
+}
+
+// Render tiles for one coordinator at a time on port, for as long as this
+// runs. Each connection gets an orbit first and then any number of tiles
+// against it, to render or to anti-alias. Returns the exit status if the port can't be listened on.
+int serve_tiles(const std::string &port, thread_pool &pool,
+                const vector<sf::Color> &gradient)
+{
+    addrinfo hints = {};
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    addrinfo *found;
+    if (getaddrinfo(nullptr, port.c_str(), &hints, &found) != 0)
+    {
+        std::cerr << "antelbrot: bad port " << port << endl;
+        return 2;
+    }
+    int server = -1;
+    for (addrinfo *a = found; a && server < 0; a = a->ai_next)
+    {
+        server = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        int on = 1;
+        if (server >= 0)
+            setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &on, sizeof on);
+        if (server >= 0 && (bind(server, a->ai_addr, a->ai_addrlen) != 0 ||
+                            listen(server, 4) != 0))
+        {
+            close(server);
+            server = -1;
+        }
+    }
+    freeaddrinfo(found);
+    if (server < 0)
+    {
+        std::cerr << "antelbrot: could not listen on port " << port << endl;
+        return 1;
+    }
+    cout << "worker: listening on port " << port << endl;
+
+    std::atomic<bool> cancel {false};
+    while (true)
+    {
+        int fd = accept(server, nullptr, nullptr);
+        if (fd < 0)
+            continue;
+        connection link(fd);
+        reference_orbit orbit;
+        mpf_class ref_r, ref_i;
+        bool have_orbit = false;
+        uint64_t type;
+        std::string payload;
+        while (link.receive_message(type, payload, aa_limit()))
+        {
+            if (type == orbit_message)
+            {
+                size_t length = orbit_length(payload);
+                std::string points;
+                have_orbit = length != 0 &&
+                             link.receive_message(type, points,
+                                                  orbit_points_limit(length)) &&
+                             type == orbit_points_message &&
+                             read_orbit(payload, points, orbit, ref_r, ref_i);
+                if (!have_orbit)
+                    break;
+                cout << "worker: orbit of " << orbit.x.size()
+                     << " iterations" << endl;
+                continue;
+            }
+            tile_job t;
+            frame tile, counts;
+            auto begin = std::chrono::steady_clock::now();
+            bool job = type == tile_message ? t.parse(payload) :
+                       type == aa_message && read_aa(payload, t, counts);
+            if (!job || !have_orbit ||
+                !render_tile_job(t, orbit, ref_r, ref_i, gradient, pool,
+                                 cancel, tile,
+                                 type == aa_message ? &counts : nullptr) ||
+                !link.send_message(result_message, result_payload(t, tile)))
+                break;
+            cout << "worker: tile at " << t.x << ", " << t.y << " in "
+                 << std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - begin).count()
+                 << endl;
+        }
+    }
+}
+
+// render one job and write its image, printing a line about it to stdout
+bool run_job(thread_pool &pool, orbit_cache *cache, gpu_kernel *gpu,
+             renderer &frames, const job &j,
+             const vector<sf::Color> &gradient)
+{
+    if (j.out.empty())
+    {
+        std::cerr << "antelbrot: no output file" << endl;
+        return false;
+    }
+    if (!j.workers.empty())
+        return run_distributed(pool, cache, j, gradient);
+    if (j.frames > 1)
+        return run_animation(pool, cache, gpu, j, gradient);
+    view v {mpf_class(), mpf_class(), j.radius, j.depth};
+    set_center(v.center_r, v.center_i, j.center_r, j.center_i, j.radius);
+
+    auto begin = std::chrono::steady_clock::now();
+    frames.set_interior_checks(j.interior_checks);
+    frames.set_subdivide(j.subdivide);
+    frames.set_gpu(j.gpu ? gpu : nullptr);
+    frames.set_antialias(j.aa);
+    frames.set_auto_depth(j.auto_depth);
+    frames.set_nucleus(j.nucleus);
+    frames.start(nullptr, j.size, v);
+    frames.wait();
+    bool saved = save_frame(j.out, frames.result(), gradient);
+    double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - begin).count();
+
+    if (!saved)
+    {
+        std::cerr << "antelbrot: could not write " << j.out << endl;
+        return false;
+    }
+    cout << j.out << ": center: " << v.center_r << " + i " << v.center_i
+         << ". zoom: " << j.radius << ". depth: "
+         << frames.result().stats.depth << ". time: " << seconds << ". "
+         << describe(frames.result().stats) << endl;
+    return true;
+}
+
+// Benchmarks
+
+// The fixed locations --bench renders: the whole set, a spiral at 1e-14, the
+// Misiurewicz point i at 1e-100 and at 1e-300 (where the deltas need
+// floatexp), the period 3 minibrot with its many interior pixels, and the
+// spirals of the seahorse valley.
+struct bench_location
+{
+    const char *name, *center_r, *center_i, *radius;
+    int depth;
+};
+
+const bench_location bench_locations[] = {
+    {"shallow", "-0.5", "0", "2", 1000},
+    {"1e-14", "-0.743643887037158704752191506114774",
+     "0.131825904205311970493132056385139", "1e-14", 10000},
+    {"1e-100", "0", "1", "1e-100", 3000},
+    {"1e-300", "0", "1", "1e-300", 3000},
+    {"minibrot", "-1.7548776662466927", "0", "0.02", 10000},
+    {"spirals", "-0.743643887037158704752191506114774",
+     "0.131825904205311970493132056385139", "1e-5", 5000},
+};
+
+// Time each benchmark location in stages: the reference orbit, the pixels
+// (series, kernel and glitch fixing, on the GPU with --gpu), coloring the
+// frame into a framebuffer, and uploading that to a texture when there is a
+// display to make one on (which present insists on). Iterations
+// count every pixel's final iteration, the part the series skips included.
+// Prints a JSON object per location and returns the exit status.
+int benchmark(const job &base, thread_pool &pool, gpu_kernel *gpu,
+              bool present)
+{
+    vector<sf::Color> gradient = default_gradient();
+    std::atomic<bool> cancel {false};
+    if (present && !has_display())
+    {
+        std::cerr << "antelbrot: no display to time the texture upload on"
+                  << endl;
+        return 2;
+    }
+    sf::Texture texture;
+    present = has_display() && texture.create(base.size.x, base.size.y);
+    auto seconds = [](std::chrono::steady_clock::time_point since)
+    {
+        return std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - since).count();
+    };
+    for (const bench_location &location : bench_locations)
+    {
+        view v {mpf_class(), mpf_class(), 0, location.depth};
+        std::istringstream(location.radius) >> v.radius;
+        set_center(v.center_r, v.center_i, location.center_r,
+                   location.center_i, v.radius);
+
+        auto begin = std::chrono::steady_clock::now();
+        reference_orbit orbit = deep_zoom_point(v.center_r, v.center_i,
+                                                v.depth,
+                                                precision_bits(v.radius));
+        double orbit_time = seconds(begin);
+
+        begin = std::chrono::steady_clock::now();
+        frame pixels(base.size, v.depth);
+        pixels.interior_checks = base.interior_checks;
+        pixels.subdivide = base.subdivide;
+        update(nullptr, pixels, orbit, v, gradient, pool, cancel,
+               base.gpu ? gpu : nullptr);
+        double render_time = seconds(begin);
+
+        framebuffer colors(base.size);
+        begin = std::chrono::steady_clock::now();
+        recolor(&colors, pixels, gradient, pool);
+        double color_time = seconds(begin);
+
+        double present_time = 0;
+        if (present)
+        {
+            begin = std::chrono::steady_clock::now();
+            colors.upload(texture);
+            present_time = seconds(begin);
+        }
+
+        double iterations = 0;
+        for (int iter : pixels.iter)
+            iterations += std::max(iter, 0);
+        double count = pixels.iter.size();
+        cout << "{\"location\": \"" << location.name << "\", \"kernel\": \""
+             << (base.gpu && gpu->usable() ? "gpu" : kernel_name)
+             << "\", \"threads\": " << pool.size()
+             << ", \"width\": " << base.size.x
+             << ", \"height\": " << base.size.y
+             << ", \"depth\": " << v.depth
+             << ", \"orbit_s\": " << orbit_time
+             << ", \"render_s\": " << render_time
+             << ", \"color_s\": " << color_time
+             << ", \"present_s\": ";
+        if (present)
+            cout << present_time;
+        else
+            cout << "null";
+        cout << ", \"orbit_iterations_per_s\": "
+             << orbit.x.size() / orbit_time
+             << ", \"pixels_per_s\": " << count / render_time
+             << ", \"iterations_per_s\": " << iterations / render_time
+             << ", \"colored_pixels_per_s\": " << count / color_time
+             << "}" << endl;
+    }
+    return 0;
 }
 
-void update(sf::VertexArray *set, const sf::Vector2u &size,
-            const vector<std::complex<double>> &x, const double &radius,
-            const vector<sf::Color> &gradient)
+// Render the images the command line asks for, one after another on the
+// whole pool, and return the exit status. Jobs in a row that keep the center
+// and depth share the reference orbit, like the frames in the window do.
+int headless(const vector<std::string> &args)
 {
-    // add a point for each pixel, coloring based on iteration
-    for (int i = 0; i != size.x; ++i)
+    job base;
+    std::string job_file;
+    unsigned threads = std::thread::hardware_concurrency();
+    bool bench = false, present = false;
+    std::string worker_port;
+    if (!parse_options(args, base, &job_file, &threads, &bench, &present,
+                       &worker_port))
+    {
+        std::cerr << usage;
+        return 2;
+    }
+
+    thread_pool pool(threads);
+    if (bench)
+    {
+        gpu_kernel gpu;
+        return benchmark(base, pool, &gpu, present);
+    }
+    vector<sf::Color> gradient = default_gradient();
+    if (!worker_port.empty())
+        return serve_tiles(worker_port, pool, gradient);
+    std::unique_ptr<orbit_cache> cache = open_orbit_cache();
+    gpu_kernel gpu;
+    renderer frames(pool, gradient, cache.get());
+    if (job_file.empty())
+        return run_job(pool, cache.get(), &gpu, frames, base, gradient) ?
+               0 : 1;
+
+    std::ifstream in(job_file);
+    if (!in)
+    {
+        std::cerr << "antelbrot: could not read " << job_file << endl;
+        return 2;
+    }
+    int failed = 0;
+    std::string line;
+    for (int number = 1; getline(in, line); ++number)
     {
-        for (int j = 0; j != size.y; ++j)
+        std::istringstream words(line);
+        vector<std::string> options;
+        std::string word;
+        while (words >> word)
+            options.push_back(word);
+        if (options.empty() || options[0][0] == '#')
+            continue;
+
+        job j = base;
+        if (!parse_options(options, j, nullptr, nullptr) ||
+            !run_job(pool, cache.get(), &gpu, frames, j, gradient))
         {
-            (*set)[i + size.x * j].position = sf::Vector2f(i, j);
-            (*set)[i + size.x * j].color = pt(i, j, x, size, radius, gradient);
+            std::cerr << job_file << ":" << number << ": job failed" << endl;
+            ++failed;
         }
     }
+    return failed == 0 ? 0 : 1;
+}
+
+// Load a font for the stats overlay, from $ANTELBROT_FONT or the usual
+// places of DejaVu Sans Mono. SFML has no font of its own.
+bool load_font(sf::Font &font)
+{
+    const char *env = getenv("ANTELBROT_FONT");
+    const char *paths[] = {
+        env,
+        "/usr/share/fonts/truetype/dejavu/DejaVuSansMono.ttf",
+        "/usr/share/fonts/TTF/DejaVuSansMono.ttf",
+        "/usr/share/fonts/dejavu/DejaVuSansMono.ttf",
+        "/usr/local/share/fonts/DejaVuSansMono.ttf",
+    };
+    for (const char *path : paths)
+        if (path && font.loadFromFile(path))
+            return true;
+    return false;
 }
 
-int main()
+int main(int argc, char **argv)
 {
+    // with any arguments, render images instead of opening the window
+    vector<std::string> args(argv + 1, argv + argc);
+    if (!args.empty())
+        return headless(args);
+
     // prepare window and the pixel array
     sf::RenderWindow window(sf::VideoMode::getDesktopMode(), "ANTelbrot");
     sf::Vector2u size = window.getSize();
-    int pixels = size.x * size.y;
-    sf::VertexArray *mandelbrot = new sf::VertexArray(sf::Points, pixels);
+    framebuffer *mandelbrot = new framebuffer(size);
+    sf::Texture texture;
+    texture.create(size.x, size.y);
+    sf::Sprite sprite(texture);
+
+    // the render threads, shared by every frame
+    thread_pool pool(std::thread::hardware_concurrency());
+    cout << "kernel: " << kernel_name << ", threads: " << pool.size() << endl;
 
 
     // prepare gradient
-    vector<sf::Color> gradient;
-    gradient.push_back(sf::Color::Black);
-    gradient.push_back(sf::Color::Blue);
-    gradient.push_back(sf::Color(128, 0, 255));
-    gradient.push_back(sf::Color::White);
-    gradient.push_back(sf::Color::Yellow);
-    gradient.push_back(sf::Color::Red);
-    gradient = color_table(gradient);
+    vector<sf::Color> gradient = default_gradient();
 
     // default starting parameters
-    double radius = 2;
+    floatexp radius = 2;
     int depth = 1000;
-    mpf_class center_r(0, 100);
-    mpf_class center_i(0, 100);
+    bool interior_checks = true;
+    bool subdivide = false;
+    bool use_gpu = false;
+    bool auto_depth = true;
+    bool nucleus = true;
+    mpf_class center_r(0, precision_bits(radius));
+    mpf_class center_i(0, precision_bits(radius));
+
+    // frames are computed in the background, the window only draws them
+    std::unique_ptr<orbit_cache> cache = open_orbit_cache();
+    gpu_kernel gpu;
+    renderer frames(pool, gradient, cache.get(), true);
+    bool reported = false;
+    frames.set_auto_depth(auto_depth);
+    frames.set_nucleus(nucleus);
+    auto redraw = [&]
+    {
+        frames.start(mandelbrot, size, view {center_r, center_i, radius, depth});
+        reported = false;
+    };
+    redraw();
+    window.setFramerateLimit(60);
 
-    // calculate the iterations for the center point to high precision.
-    vector<std::complex<double>> x = deep_zoom_point(center_r, center_i, depth);
-    update(mandelbrot, size, x, radius, gradient);
+    // the stats of the last finished frame, in a corner of the window
+    sf::Font font;
+    bool have_font = load_font(font);
+    bool show_stats = false;
+    sf::Text overlay;
+    overlay.setFont(font);
+    overlay.setCharacterSize(14);
+    overlay.setFillColor(sf::Color::White);
+    overlay.setOutlineColor(sf::Color::Black);
+    overlay.setOutlineThickness(1);
+    overlay.setPosition(8, 8);
 
     // window loop
     while (window.isOpen())
     {
+        if (!reported && frames.done())
+        {
+            const frame_stats &stats = frames.result().stats;
+            depth = stats.depth;
+            cout << "center: " << center_r << " + i " << center_i
+                 << ". zoom: " << radius << ". depth: " << depth << ". "
+                 << describe(stats) << endl;
+            overlay.setString(describe(stats, "\n"));
+            reported = true;
+        }
+        mandelbrot->upload(texture);
         window.clear();
-        window.draw(*mandelbrot);
+        window.draw(sprite);
+        if (show_stats)
+            window.draw(overlay);
         window.display();
         sf::Event event;
         while (window.pollEvent(event))
@@ -189,11 +6055,14 @@ int main()
                 // make sure the view gets resized as well
                 window.setView(sf::View(sf::FloatRect(0, 0, size.x, size.y)));
 
-                // resize the vertex array
-                pixels = size.x * size.y;
-                mandelbrot->resize(pixels);
+                // resize the framebuffer and its texture, once nothing
+                // draws into them
+                frames.stop();
+                mandelbrot->resize(size);
+                texture.create(size.x, size.y);
+                sprite.setTexture(texture, true);
 
-                update(mandelbrot, size, x, radius, gradient);
+                redraw();
                 break;
             }
             case sf::Event::MouseButtonPressed:
@@ -201,14 +6070,23 @@ int main()
                 if (event.mouseButton.button == sf::Mouse::Left)
                 {
                     sf::Vector2f mouse(event.mouseButton.x, event.mouseButton.y);
-                    center_r += radius * (2 * mouse.x - (int) size.x) / size.y;
-                    center_i += -radius * (2 * mouse.y - (int) size.y) / size.y;
+                    // the new center needs the precision of the new radius
+                    fit_precision(center_r, center_i, radius / 2);
+                    // move onto the clicked pixel, the same way pixel_delta
+                    // finds it
+                    mp_bitcnt_t bits = center_r.get_prec();
+                    double window_radius = std::min(size.x, size.y);
+                    floatexp offset_r = radius *
+                        ((2 * (int) mouse.x - (int) size.x) / window_radius);
+                    floatexp offset_i = -radius *
+                        ((2 * (int) mouse.y - (int) size.y) / window_radius);
+                    center_r += offset_r.get_mpf(bits);
+                    center_i += offset_i.get_mpf(bits);
                     radius /= 2;
                     cout << "center: " << center_r << " + i " << 
                         center_i << ". zoom: " << radius << endl;
-                    x = deep_zoom_point(center_r, center_i, depth);
 
-                    update(mandelbrot, size, x, radius, gradient);
+                    redraw();
                 }
                 break;
             }
@@ -223,32 +6101,28 @@ int main()
                 {
                     cout << "Enter the new zoom radius: " << endl;
                     cin >> radius;
-                    update(mandelbrot, size, x, radius, gradient);
+                    redraw();
                     break;
                 }
                 case sf::Keyboard::D:
                 {
                     cout << "Enter the new iteration depth: " << endl;
                     cin >> depth;
-                    cout << "depth: " << depth << ". zoom: " << radius << endl;
+                    auto_depth = false;
+                    frames.set_auto_depth(false);
+                    cout << "depth: " << depth << " (automatic depth off)"
+                         << ". zoom: " << radius << endl;
 
-                    x = deep_zoom_point(center_r, center_i, depth);
-                    update(mandelbrot, size, x, radius, gradient);
+                    redraw();
                     break;
                 }
                 case sf::Keyboard::I:
                 {
 
-                    // regex for detecting valid float numbers 
-                    // a string of digits, optionally followed by a decimal 
-                    // point and another string of digits, 
-                    // optionally followed by an exponent
-                    std::regex valid_float {"-?\\d+(.\\d*)?(e(\\+|-)?\\d+)?"};
                     std::string r_str, i_str;
 
                     // validate strings entered
-                    while(!std::regex_match(r_str, valid_float) ||
-                          !std::regex_match(i_str, valid_float))
+                    while(!valid_coordinate(r_str) || !valid_coordinate(i_str))
                     {
 
                         cout << "Enter the real coordinate value: " << endl;
@@ -264,14 +6138,92 @@ int main()
                         i_str.erase(remove_if(i_str.begin(), i_str.end(), 
                             [] (char c) {return c == ',';}), i_str.end());
                     }
-                    center_r = mpf_class(r_str.c_str(), 100);
-                    center_i = mpf_class(i_str.c_str(), 100);
+                    set_center(center_r, center_i, r_str, i_str, radius);
 
                     cout << "center: " << center_r << " + i " << center_i 
                          << ". zoom: " << radius << endl;
 
-                    x = deep_zoom_point(center_r, center_i, depth);
-                    update(mandelbrot, size, x, radius, gradient);
+                    redraw();
+                    break;
+                }
+                case sf::Keyboard::P:
+                {
+                    interior_checks = !interior_checks;
+                    frames.set_interior_checks(interior_checks);
+                    cout << "interior checks: "
+                         << (interior_checks ? "on" : "off") << endl;
+
+                    redraw();
+                    break;
+                }
+                case sf::Keyboard::M:
+                {
+                    subdivide = !subdivide;
+                    frames.set_subdivide(subdivide);
+                    cout << "subdivision: " << (subdivide ? "on" : "off")
+                         << endl;
+
+                    redraw();
+                    break;
+                }
+                case sf::Keyboard::G:
+                {
+                    use_gpu = !use_gpu;
+                    frames.set_gpu(use_gpu ? &gpu : nullptr);
+                    cout << "GPU: " << (use_gpu ? "on" : "off") << endl;
+
+                    redraw();
+                    break;
+                }
+                case sf::Keyboard::A:
+                {
+                    auto_depth = !auto_depth;
+                    frames.set_auto_depth(auto_depth);
+                    cout << "automatic depth: " << (auto_depth ? "on" : "off")
+                         << endl;
+
+                    redraw();
+                    break;
+                }
+                case sf::Keyboard::N:
+                {
+                    nucleus = !nucleus;
+                    frames.set_nucleus(nucleus);
+                    cout << "nucleus reference: " << (nucleus ? "on" : "off")
+                         << endl;
+
+                    redraw();
+                    break;
+                }
+                case sf::Keyboard::S:
+                {
+                    show_stats = have_font && !show_stats;
+                    if (!have_font)
+                        cout << "no font for the stats, set ANTELBROT_FONT"
+                             << endl;
+                    else
+                        cout << "stats: " << (show_stats ? "on" : "off")
+                             << endl;
+                    break;
+                }
+                case sf::Keyboard::C:
+                {
+                    // shift the gradient along by one iteration, which
+                    // palette() spreads over 10 colors, backwards with shift.
+                    // Then paint the frame from its results. A frame still in
+                    // progress goes on with the new colors.
+                    bool done = frames.done();
+                    frames.stop();
+                    int cycle = 10;
+                    if (event.key.shift)
+                        std::rotate(gradient.rbegin(), gradient.rbegin() + cycle,
+                                    gradient.rend());
+                    else
+                        std::rotate(gradient.begin(), gradient.begin() + cycle,
+                                    gradient.end());
+                    recolor(mandelbrot, frames.result(), gradient, pool);
+                    if (!done)
+                        redraw();
                     break;
                 }
                 case sf::Keyboard::Z:
@@ -280,7 +6232,7 @@ int main()
                     cout << "center: " << center_r << " + i " << center_i 
                          << ". zoom: " << radius << endl;
 
-                    update(mandelbrot, size, x, radius, gradient);
+                    redraw();
                     break;
                 }
                 } // end keyboard input switch
@@ -289,6 +6241,7 @@ int main()
             } // end event switch
         }
     }
+    frames.stop();
     delete mandelbrot;
     return 0;
 }